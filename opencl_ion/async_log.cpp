@@ -0,0 +1,231 @@
+#include "async_log.hpp"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/*
+ * bounded multi-producer ring (vyukov): a slot is free for the producer
+ * whose ticket equals its sequence, readable once the sequence is
+ * ticket + 1, and free again for ticket + ASYNC_LOG_SLOTS after the
+ * flusher consumed it.
+ */
+struct LogSlot {
+    std::atomic<uint64_t> sequence;
+    int                   priority;
+    unsigned int          sinks;
+    char                  text[ASYNC_LOG_MSG_SIZE];
+};
+
+struct LogRing {
+    LogSlot               slots[ASYNC_LOG_SLOTS];
+    std::atomic<uint64_t> head; // next ticket for producers
+    std::atomic<uint64_t> tail; // next slot for the flusher, only it writes
+    std::atomic<unsigned long> dropped;
+    std::atomic<bool>     running;
+    std::mutex            mutex; // flusher sleep and async_log_flush() only
+    std::condition_variable wake;
+    std::condition_variable drained;
+    std::thread           flusher;
+};
+
+static LogRing& ring();
+
+static int64_t now_ms()
+{
+    struct timespec ts;
+
+    /* a few ns, no syscall on linux */
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void write_message(int priority, unsigned int sinks, const char *text)
+{
+    if (sinks & ASYNC_LOG_SYSLOG) {
+        syslog(priority, "%s", text);
+    }
+
+    if (sinks & ASYNC_LOG_STDOUT) {
+        fputs(text, stdout);
+        fputc('\n', stdout);
+    }
+}
+
+static bool drain(LogRing& log)
+{
+    uint64_t tail = log.tail.load(std::memory_order_relaxed);
+    bool     any  = false;
+
+    for (;;) {
+        LogSlot& slot = log.slots[tail & (ASYNC_LOG_SLOTS - 1)];
+
+        if (slot.sequence.load(std::memory_order_acquire) != tail + 1) {
+            break;
+        }
+
+        write_message(slot.priority, slot.sinks, slot.text);
+        slot.sequence.store(tail + ASYNC_LOG_SLOTS, std::memory_order_release);
+        tail++;
+        any = true;
+    }
+
+    if (any) {
+        fflush(stdout);
+        log.tail.store(tail, std::memory_order_release);
+    }
+
+    return any;
+}
+
+static void flusher_main(LogRing *log)
+{
+    std::unique_lock<std::mutex> lock(log->mutex);
+
+    while (log->running.load()) {
+        lock.unlock();
+        bool any = drain(*log);
+        lock.lock();
+
+        if (any) {
+            log->drained.notify_all();
+            continue;
+        }
+
+        /* producers never signal, a short nap bounds the latency instead */
+        log->wake.wait_for(lock, std::chrono::milliseconds(10));
+    }
+
+    lock.unlock();
+    drain(*log);
+    lock.lock();
+    log->drained.notify_all();
+}
+
+static void stop_flusher()
+{
+    LogRing& log = ring();
+
+    {
+        std::lock_guard<std::mutex> lock(log.mutex);
+        log.running.store(false);
+        log.wake.notify_all();
+    }
+
+    log.flusher.join();
+}
+
+static LogRing& ring()
+{
+    /* never destroyed, static destructors may still log */
+    static LogRing *log = []() {
+        LogRing *created = new LogRing();
+
+        for (uint64_t i = 0; i < ASYNC_LOG_SLOTS; i++) {
+            created->slots[i].sequence.store(i);
+        }
+        created->head.store(0);
+        created->tail.store(0);
+        created->dropped.store(0);
+        created->running.store(true);
+        created->flusher = std::thread(flusher_main, created);
+        atexit(stop_flusher);
+
+        return created;
+    }();
+
+    return *log;
+}
+
+bool async_log_allow(AsyncLogSite *site)
+{
+    int64_t now    = now_ms();
+    int64_t window = site->window_ms.load(std::memory_order_relaxed);
+
+    if ((now - window >= 1000) &&
+        site->window_ms.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+        site->count.store(0, std::memory_order_relaxed);
+    }
+
+    if (site->count.fetch_add(1, std::memory_order_relaxed) < ASYNC_LOG_RATE) {
+        return true;
+    }
+
+    site->suppressed.fetch_add(1, std::memory_order_relaxed);
+
+    return false;
+}
+
+void async_log_write(AsyncLogSite *site, int priority, unsigned int sinks,
+                     const char *fmt, ...)
+{
+    LogRing& log = ring();
+    char     text[ASYNC_LOG_MSG_SIZE];
+    va_list  args;
+
+    va_start(args, fmt);
+    int len = vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+
+    uint32_t suppressed = site ? site->suppressed.exchange(0, std::memory_order_relaxed) : 0;
+
+    if ((suppressed > 0) && (len >= 0) && ((size_t)len < sizeof(text))) {
+        snprintf(text + len, sizeof(text) - len, " (%u suppressed)", suppressed);
+    }
+
+    /* after exit() started the flusher may be gone, write directly */
+    if (!log.running.load(std::memory_order_relaxed)) {
+        write_message(priority, sinks, text);
+        return;
+    }
+
+    uint64_t ticket = log.head.load(std::memory_order_relaxed);
+
+    for (;;) {
+        LogSlot& slot     = log.slots[ticket & (ASYNC_LOG_SLOTS - 1)];
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+
+        if (sequence == ticket) {
+            if (log.head.compare_exchange_weak(ticket, ticket + 1, std::memory_order_relaxed)) {
+                slot.priority = priority;
+                slot.sinks    = sinks;
+                memcpy(slot.text, text, sizeof(text));
+                slot.sequence.store(ticket + 1, std::memory_order_release);
+                return;
+            }
+        } else if (sequence < ticket) {
+            /* the flusher is a whole ring behind */
+            log.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            ticket = log.head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void async_log_flush()
+{
+    LogRing& log = ring();
+    uint64_t target = log.head.load();
+    std::unique_lock<std::mutex> lock(log.mutex);
+
+    log.wake.notify_all();
+
+    /* a producer holding a ticket below target may still be copying, the
+       timed wait covers the notify that raced with it */
+    while (log.running.load() && (log.tail.load(std::memory_order_acquire) < target)) {
+        log.drained.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+unsigned long async_log_dropped()
+{
+    return ring().dropped.load();
+}
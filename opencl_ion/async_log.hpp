@@ -0,0 +1,98 @@
+#ifndef __ASYNC_LOG_HPP__
+#define __ASYNC_LOG_HPP__
+
+#include <stdint.h>
+#include <syslog.h>
+#include <atomic>
+
+/*
+ * logging off the hot path: a call formats into a slot of a lock-free ring
+ * and returns, a background thread does the syslog()/stdout writes. a full
+ * ring drops the message (counted) rather than block.
+ *
+ * messages above ASYNC_LOG_LEVEL (a syslog priority, e.g. -DASYNC_LOG_LEVEL=
+ * LOG_WARNING) are compiled out; every call site passes at most
+ * ASYNC_LOG_RATE messages a second and reports how many it suppressed.
+ */
+#ifndef ASYNC_LOG_LEVEL
+#define ASYNC_LOG_LEVEL LOG_INFO
+#endif
+
+#ifndef ASYNC_LOG_RATE
+#define ASYNC_LOG_RATE 20 // messages per second and call site
+#endif
+
+#define ASYNC_LOG_SLOTS    1024 // ring capacity, a power of two
+#define ASYNC_LOG_MSG_SIZE 256  // bytes per message, longer ones are cut
+
+enum AsyncLogSink {
+    ASYNC_LOG_SYSLOG = 1 << 0,
+    ASYNC_LOG_STDOUT = 1 << 1,
+};
+
+/* per call site rate limit state, static in the logging macros */
+struct AsyncLogSite {
+    std::atomic<int64_t>  window_ms;  // start of the current second
+    std::atomic<uint32_t> count;      // messages in the current second
+    std::atomic<uint32_t> suppressed; // dropped by the limit since the last message
+};
+
+/**
+ * @param  site [call site]
+ * @return      [true if the site may log now]
+ */
+bool async_log_allow(AsyncLogSite *site);
+
+/**
+ * queue a printf style message
+ * @param  site     [call site, for the suppressed count]
+ * @param  priority [syslog priority]
+ * @param  sinks    [AsyncLogSink bits]
+ * @param  fmt      [printf format]
+ */
+void async_log_write(AsyncLogSite *site, int priority, unsigned int sinks,
+                     const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+
+/**
+ * wait until every queued message is written, e.g. before abort()
+ */
+void async_log_flush();
+
+/**
+ * @return [messages dropped because the ring was full]
+ */
+unsigned long async_log_dropped();
+
+#define ASYNC_LOG(priority, sinks, fmt, args ...)                          \
+    do {                                                                   \
+        static AsyncLogSite async_log_site_;                               \
+        if (async_log_allow(&async_log_site_)) {                           \
+            async_log_write(&async_log_site_, priority, sinks, fmt, ## args); \
+        }                                                                  \
+    } while (0)
+
+#if ASYNC_LOG_LEVEL >= LOG_ERR
+#define ASYNC_LOG_ERR(sinks, fmt, args ...) ASYNC_LOG(LOG_ERR, sinks, fmt, ## args)
+#else
+#define ASYNC_LOG_ERR(sinks, fmt, args ...) do {} while (0)
+#endif
+
+#if ASYNC_LOG_LEVEL >= LOG_WARNING
+#define ASYNC_LOG_WARN(sinks, fmt, args ...) ASYNC_LOG(LOG_WARNING, sinks, fmt, ## args)
+#else
+#define ASYNC_LOG_WARN(sinks, fmt, args ...) do {} while (0)
+#endif
+
+#if ASYNC_LOG_LEVEL >= LOG_INFO
+#define ASYNC_LOG_INFO(sinks, fmt, args ...) ASYNC_LOG(LOG_INFO, sinks, fmt, ## args)
+#else
+#define ASYNC_LOG_INFO(sinks, fmt, args ...) do {} while (0)
+#endif
+
+#if ASYNC_LOG_LEVEL >= LOG_DEBUG
+#define ASYNC_LOG_DEBUG(sinks, fmt, args ...) ASYNC_LOG(LOG_DEBUG, sinks, fmt, ## args)
+#else
+#define ASYNC_LOG_DEBUG(sinks, fmt, args ...) do {} while (0)
+#endif
+
+#endif // ifndef __ASYNC_LOG_HPP__
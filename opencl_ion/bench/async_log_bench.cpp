@@ -0,0 +1,74 @@
+/*
+ * caller-side cost of one log call in the allocation path:
+ *   syslog     - the old ERR()/INFO(), a blocking syslog() per call
+ *   async      - one message queued to the async_log.hpp ring
+ *   limited    - a call site over its rate limit, the common case in a
+ *                failure storm
+ *   stripped   - ASYNC_LOG_DEBUG() above the default ASYNC_LOG_LEVEL,
+ *                compiled out
+ *
+ * usage: async_log_bench [calls]
+ */
+#include "../async_log.hpp"
+#include "bench_common.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv)
+{
+    int calls = (argc > 1) ? atoi(argv[1]) : 100000;
+
+    /* the ring holds ASYNC_LOG_SLOTS messages, stay below it to time the
+       producer and not the drops */
+    int batch = ASYNC_LOG_SLOTS / 2;
+
+    openlog("async_log_bench", 0, LOG_USER);
+
+    double start = now_seconds();
+
+    for (int i = 0; i < calls; i++) {
+        syslog(LOG_INFO, "I %d, alloc %d bytes failed", __LINE__, i);
+    }
+    double syslog_ns = (now_seconds() - start) * 1e9 / calls;
+
+    double async_s = 0;
+
+    for (int done = 0; done < calls; done += batch) {
+        start = now_seconds();
+
+        for (int i = 0; i < batch; i++) {
+            async_log_write(NULL, LOG_INFO, ASYNC_LOG_SYSLOG,
+                            "I %d, alloc %d bytes failed", __LINE__, i);
+        }
+        async_s += now_seconds() - start;
+        async_log_flush();
+    }
+    double async_ns = async_s * 1e9 / calls;
+
+    /* the first ASYNC_LOG_RATE calls pass, the rest are suppressed */
+    start = now_seconds();
+
+    for (int i = 0; i < calls; i++) {
+        ASYNC_LOG_INFO(ASYNC_LOG_SYSLOG, "I %d, alloc %d bytes failed", __LINE__, i);
+    }
+    double limited_ns = (now_seconds() - start) * 1e9 / calls;
+
+    start = now_seconds();
+
+    for (int i = 0; i < calls; i++) {
+        ASYNC_LOG_DEBUG(ASYNC_LOG_SYSLOG, "D %d, alloc %d bytes", __LINE__, i);
+    }
+    double stripped_ns = (now_seconds() - start) * 1e9 / calls;
+
+    async_log_flush();
+
+    printf("%-10s %10s\n", "path", "ns/call");
+    printf("%-10s %10.1f\n", "syslog", syslog_ns);
+    printf("%-10s %10.1f\n", "async", async_ns);
+    printf("%-10s %10.1f\n", "limited", limited_ns);
+    printf("%-10s %10.1f\n", "stripped", stripped_ns);
+    printf("dropped %lu\n", async_log_dropped());
+
+    return 0;
+}
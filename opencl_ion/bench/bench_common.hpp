@@ -0,0 +1,15 @@
+#ifndef __BENCH_COMMON_HPP__
+#define __BENCH_COMMON_HPP__
+
+#include <chrono>
+
+/**
+ * @return [monotonic time in seconds]
+ */
+static inline double now_seconds()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif // ifndef __BENCH_COMMON_HPP__
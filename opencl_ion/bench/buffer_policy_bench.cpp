@@ -0,0 +1,192 @@
+/*
+ * sweeps every BufferFactory config over the three access patterns and a
+ * set of buffer sizes, printing one csv row per combination:
+ *   pattern,alloc,policy,bytes,map_ms,kernel_ms,host_ms
+ * map_ms is the begin/end host access overhead, host_ms the cpu loop.
+ *
+ * usage: buffer_policy_bench [size_bytes ...]
+ */
+#include "../buffer_factory.hpp"
+#include "../gen/cl_sources.hpp"
+#include "bench_common.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct Timing {
+    double map_ms;
+    double kernel_ms;
+    double host_ms;
+};
+
+static const char *pattern_names[] = {
+    "host-write/device-read", "device-write/host-read", "ping-pong"
+};
+
+static bool host_pass(cl::CommandQueue& command_queue, ZeroCopyBuffer& buffer,
+                      cl_map_flags flags, Timing& timing)
+{
+    double start = now_seconds();
+    int   *data  = (int *)buffer.begin_host_access(command_queue, flags);
+
+    if (data == NULL) {
+        return (false);
+    }
+
+    double loop_start = now_seconds();
+    size_t count      = buffer.size() / sizeof(int);
+    volatile int sum  = 0;
+
+    if (flags & CL_MAP_WRITE) {
+        for (size_t i = 0; i < count; i++) {
+            data[i] = (int)i;
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            sum += data[i];
+        }
+    }
+
+    double loop_end = now_seconds();
+
+    if (!buffer.end_host_access(command_queue, data)) {
+        return (false);
+    }
+
+    timing.host_ms += (loop_end - loop_start) * 1000.0;
+    timing.map_ms  += (now_seconds() - start - (loop_end - loop_start)) * 1000.0;
+
+    return (true);
+}
+
+static bool run(cl::CommandQueue& command_queue, cl::Kernel& kernel,
+                BufferFactory& factory, BufferAccessPattern pattern,
+                const BufferConfig& config, size_t size, Timing& timing)
+{
+    ZeroCopyBuffer buffer;
+
+    if (!factory.create(size, config, CL_MEM_READ_WRITE, buffer)) {
+        return (false);
+    }
+
+    timing.map_ms = timing.kernel_ms = timing.host_ms = 0;
+
+    if ((pattern != ACCESS_DEVICE_WRITE_HOST_READ) &&
+        !host_pass(command_queue, buffer, CL_MAP_WRITE, timing)) {
+        return (false);
+    }
+
+    double start = now_seconds();
+
+    kernel.setArg(0, buffer.buffer());
+    command_queue.enqueueNDRangeKernel(kernel,
+                                       cl::NullRange,
+                                       cl::NDRange(size / sizeof(int)),
+                                       cl::NullRange, NULL, NULL);
+    command_queue.finish();
+    timing.kernel_ms = (now_seconds() - start) * 1000.0;
+
+    if ((pattern != ACCESS_HOST_WRITE_DEVICE_READ) &&
+        !host_pass(command_queue, buffer, CL_MAP_READ, timing)) {
+        return (false);
+    }
+
+    return (true);
+}
+
+int main(int argc, const char *argv[])
+{
+    static const cl_uint policies[] = {
+        CL_MEM_HOST_UNCACHED_QCOM,
+        CL_MEM_HOST_WRITEBACK_QCOM,
+        CL_MEM_HOST_WRITE_COMBINING_QCOM,
+        CL_MEM_HOST_IOCOHERENT_QCOM,
+    };
+
+    cl::Context context;
+    cl::CommandQueue command_queue;
+    std::vector<cl::Device> devices;
+    cl::Program program;
+    std::vector<size_t> sizes;
+
+    for (int i = 1; i < argc; i++) {
+        sizes.push_back(strtoul(argv[i], NULL, 0));
+    }
+
+    if (sizes.empty()) {
+        sizes.push_back(1024 * 1024);
+        sizes.push_back(1024 * 1024 * 8);
+        sizes.push_back(1024 * 1024 * 32);
+        sizes.push_back(1024 * 1024 * 128);
+    }
+
+    CreateContext(context);
+    GetDeivces(context, devices);
+    CreateCommandQueue(context, command_queue, devices.front());
+
+    std::vector<ClSourceBlob> blobs(1, cl_source_bench);
+
+    if (!CreateProgram(context, devices, blobs, program)) {
+        return -1;
+    }
+
+    cl::Kernel kernel = cl::Kernel(program, "increment");
+    BufferFactory factory;
+    factory.init(context, devices.front());
+
+    std::vector<BufferConfig> configs;
+    BufferConfig config;
+
+    config.host_cache_policy = 0;
+
+    for (int type = BUFFER_ALLOC_HOST_PTR; type <= BUFFER_ALLOC_SVM; type++) {
+        config.alloc_type = (BufferAllocType)type;
+
+        if (factory.is_supported(config)) {
+            configs.push_back(config);
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+        config.alloc_type        = BUFFER_ALLOC_ION_HOST_PTR;
+        config.host_cache_policy = policies[i];
+
+        if (factory.is_supported(config)) {
+            configs.push_back(config);
+        }
+    }
+
+    printf("pattern,alloc,policy,bytes,map_ms,kernel_ms,host_ms\n");
+
+    for (int pattern = 0; pattern < ACCESS_PATTERN_COUNT; pattern++) {
+        for (size_t c = 0; c < configs.size(); c++) {
+            for (size_t s = 0; s < sizes.size(); s++) {
+                Timing timing;
+
+                if (!run(command_queue, kernel, factory, (BufferAccessPattern)pattern,
+                         configs[c], sizes[s], timing)) {
+                    fprintf(stderr, "failed: %s %zu\n", pattern_names[pattern], sizes[s]);
+                    continue;
+                }
+
+                printf("%s,%s,%s,%zu,%.3f,%.3f,%.3f\n",
+                       pattern_names[pattern],
+                       BufferAllocTypeToString(configs[c].alloc_type),
+                       configs[c].alloc_type == BUFFER_ALLOC_ION_HOST_PTR
+                       ? HostCachePolicyToString(configs[c].host_cache_policy) : "-",
+                       sizes[s], timing.map_ms, timing.kernel_ms, timing.host_ms);
+            }
+        }
+    }
+
+    for (int pattern = 0; pattern < ACCESS_PATTERN_COUNT; pattern++) {
+        BufferConfig chosen = factory.default_config((BufferAccessPattern)pattern);
+        printf("# default %s: %s %s\n", pattern_names[pattern],
+               BufferAllocTypeToString(chosen.alloc_type),
+               HostCachePolicyToString(chosen.host_cache_policy));
+    }
+
+    printf("# zero-copy strategy: %s\n", BufferAllocTypeToString(factory.zero_copy_strategy()));
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * per-frame cost of importing producer buffers with and without the
+ * DmaBufImporter cache. a memfd producer stands in for the camera: it owns
+ * a ring of buffers and hands a fresh dup of one fd per frame, like an fd
+ * received over a unix socket. the kernel writes through the import and
+ * the producer mapping checks the result, so the path is zero-copy.
+ *
+ * usage: dma_buf_import_bench [frame_bytes] [frames] [ring_size]
+ */
+#include "../dma_buf_import.hpp"
+#include "../ion_backend.hpp"
+#include "../gen/cl_sources.hpp"
+#include "bench_common.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static bool run(const char *name, cl::Context context, cl::CommandQueue command_queue,
+                cl::Kernel kernel, std::vector<IonBuffer>& ring, size_t frame_bytes,
+                int frames, bool cached)
+{
+    DmaBufImporter importer;
+    double import_seconds = 0;
+    int diffs             = 0;
+
+    importer.init(context);
+
+    for (int frame = 0; frame < frames; frame++) {
+        IonBuffer& produced = ring[frame % ring.size()];
+        int received_fd     = dup(produced.fd);
+        cl::Buffer buffer;
+
+        if (!cached) {
+            importer.clear();
+        }
+
+        double start = now_seconds();
+
+        if (!importer.import_buffer(received_fd, frame_bytes, buffer)) {
+            close(received_fd);
+            return (false);
+        }
+        import_seconds += now_seconds() - start;
+        close(received_fd);
+
+        kernel.setArg(0, buffer);
+        command_queue.enqueueNDRangeKernel(kernel,
+                                           cl::NullRange,
+                                           cl::NDRange(frame_bytes / sizeof(int)),
+                                           cl::NullRange, NULL, NULL);
+        command_queue.finish();
+
+        const int *result = (const int *)produced.vaddr;
+        diffs += (result[frame_bytes / sizeof(int) - 1] != (int)(frame_bytes / sizeof(int) - 1));
+    }
+
+    printf("%-10s %8.3f ms/frame import  hits %lu misses %lu  diffs %d\n", name,
+           import_seconds * 1000.0 / frames, importer.hits(), importer.misses(), diffs);
+
+    return (true);
+}
+
+int main(int argc, const char *argv[])
+{
+    size_t frame_bytes = argc > 1 ? strtoul(argv[1], NULL, 0) : 1920 * 1080 * 4;
+    int frames         = argc > 2 ? atoi(argv[2]) : 100;
+    int ring_size      = argc > 3 ? atoi(argv[3]) : 4;
+
+    cl::Context context;
+    cl::CommandQueue command_queue;
+    std::vector<cl::Device> devices;
+    cl::Program program;
+
+    CreateContext(context);
+    GetDeivces(context, devices);
+    CreateCommandQueue(context, command_queue, devices.front());
+
+    std::vector<ClSourceBlob> blobs(1, cl_source_hello);
+
+    if (!CreateProgram(context, devices, blobs, program)) {
+        return -1;
+    }
+
+    cl::Kernel hello_kernel = cl::Kernel(program, "hello");
+
+    IonAllocator producer(ion_create_backend(ION_BACKEND_MEMFD));
+    std::vector<IonBuffer> ring(ring_size);
+
+    for (int i = 0; i < ring_size; i++) {
+        if (producer.allocate(frame_bytes, ring[i], 0, "producer") < 0) {
+            return -2;
+        }
+    }
+
+    printf("frame %zu bytes, %d frames, ring of %d %s buffers\n", frame_bytes, frames,
+           ring_size, producer.backend()->name());
+
+    if (!run("uncached", context, command_queue, hello_kernel, ring, frame_bytes, frames, false) ||
+        !run("cached", context, command_queue, hello_kernel, ring, frame_bytes, frames, true)) {
+        return -3;
+    }
+
+    return 0;
+}
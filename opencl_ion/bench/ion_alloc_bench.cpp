@@ -0,0 +1,118 @@
+/*
+ * allocations/sec of the per-call ion_allocate()/ion_free() pair against a
+ * persistent IonAllocator.
+ *
+ * usage: ion_alloc_bench [size_bytes] [iterations] [threads]
+ *
+ * without /dev/ion the benchmark runs against a memfd stand-in device, which
+ * still pays the open()/close() and path lookup of the free functions.
+ */
+#include "../ion_wrapper.hpp"
+#include "bench_common.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void report(const char *name, int allocations, double seconds)
+{
+    printf("%-28s %8d allocs %10.3f ms %12.0f allocs/sec\n",
+           name, allocations, seconds * 1000.0, allocations / seconds);
+}
+
+static int run_free_functions(const char *device_path, int size, int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        IonBuffer buf;
+
+        if (ion_allocate(size, buf, device_path) < 0) {
+            return -1;
+        }
+        ion_free(buf);
+    }
+
+    return 0;
+}
+
+static int run_allocator(IonAllocator *allocator, int size, int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        IonBuffer buf;
+
+        if (allocator->allocate(size, buf) < 0) {
+            return -1;
+        }
+        allocator->free(buf);
+    }
+
+    return 0;
+}
+
+int main(int argc, const char *argv[])
+{
+    int size       = argc > 1 ? atoi(argv[1]) : 4096;
+    int iterations = argc > 2 ? atoi(argv[2]) : 10000;
+    int threads    = argc > 3 ? atoi(argv[3]) : 4;
+
+    std::string device_path = ION_DEVICE_PATH;
+    int stand_in_fd         = -1;
+
+    if (access(ION_DEVICE_PATH, R_OK) != 0) {
+        stand_in_fd = syscall(SYS_memfd_create, "ion-device-stand-in", 0);
+
+        if (stand_in_fd < 0) {
+            fprintf(stderr, "no %s and memfd_create failed\n", ION_DEVICE_PATH);
+            return -1;
+        }
+        device_path = "/proc/self/fd/" + std::to_string(stand_in_fd);
+        printf("%s not present, using memfd stand-in %s\n",
+               ION_DEVICE_PATH, device_path.c_str());
+    }
+
+    printf("size %d bytes, %d iterations, %d threads\n", size, iterations, threads);
+
+    double start = now_seconds();
+
+    if (run_free_functions(device_path.c_str(), size, iterations) < 0) {
+        fprintf(stderr, "ion_allocate failed\n");
+        return -2;
+    }
+    report("ion_allocate/ion_free", iterations, now_seconds() - start);
+
+    IonAllocator allocator(device_path.c_str());
+
+    if (!allocator.is_valid()) {
+        return -3;
+    }
+
+    start = now_seconds();
+
+    if (run_allocator(&allocator, size, iterations) < 0) {
+        fprintf(stderr, "IonAllocator::allocate failed\n");
+        return -4;
+    }
+    report("IonAllocator", iterations, now_seconds() - start);
+
+    std::vector<std::thread> workers;
+    start = now_seconds();
+
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::thread(run_allocator, &allocator, size, iterations));
+    }
+
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+    report("IonAllocator (threads)", iterations * threads, now_seconds() - start);
+
+    if (stand_in_fd >= 0) {
+        close(stand_in_fd);
+    }
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * host read-back of a kernel result in an ion buffer (the verification loop
+ * of main.cpp) with three host cache setups:
+ *   uncached            - CL_MEM_HOST_UNCACHED_QCOM, enqueueMapBuffer
+ *   write-back full     - CL_MEM_HOST_WRITEBACK_QCOM, invalidate whole buffer
+ *   write-back range    - CL_MEM_HOST_WRITEBACK_QCOM, invalidate read bytes
+ *
+ * usage: ion_cache_bench [size_bytes] [read_bytes]
+ */
+#include "../ion_cl.hpp"
+#include "../gen/cl_sources.hpp"
+#include "bench_common.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+enum ReadMode {
+    READ_UNCACHED_MAP,
+    READ_WRITEBACK_FULL_SYNC,
+    READ_WRITEBACK_RANGE_SYNC,
+};
+
+static int count_diffs(const int *result, size_t count)
+{
+    int diffs = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if ((int)i != result[i]) {
+            diffs++;
+        }
+    }
+
+    return diffs;
+}
+
+static bool run(cl::Context context, cl::CommandQueue command_queue,
+                cl::Kernel kernel, ReadMode mode, size_t size, size_t read_bytes)
+{
+    static const char *names[] = {
+        "uncached + map", "write-back + full sync", "write-back + range sync"
+    };
+
+    IonBuffer ion_buffer;
+    cl::Buffer buffer;
+    cl_uint policy = (mode == READ_UNCACHED_MAP) ? CL_MEM_HOST_UNCACHED_QCOM
+                                                 : CL_MEM_HOST_WRITEBACK_QCOM;
+
+    if ((IonAllocator::instance().allocate(size, ion_buffer) < 0) ||
+        !CreateIonBuffer(context, CL_MEM_WRITE_ONLY, ion_buffer, policy, buffer, size)) {
+        return (false);
+    }
+
+    kernel.setArg(0, buffer);
+    command_queue.enqueueNDRangeKernel(kernel,
+                                       cl::NullRange,
+                                       cl::NDRange(size / sizeof(int)),
+                                       cl::NullRange, NULL, NULL);
+    command_queue.finish();
+
+    double start = now_seconds();
+    int diffs    = 0;
+
+    if (mode == READ_UNCACHED_MAP) {
+        int *result = (int *)command_queue.enqueueMapBuffer(buffer, CL_TRUE,
+                                                            CL_MAP_READ, 0, size);
+        diffs = count_diffs(result, read_bytes / sizeof(int));
+        command_queue.enqueueUnmapMemObject(buffer, result);
+        command_queue.finish();
+    } else {
+        size_t sync_bytes = (mode == READ_WRITEBACK_FULL_SYNC) ? 0 : read_bytes;
+
+        if (ion_cache_sync(ion_buffer, ION_CACHE_INVALIDATE, 0, sync_bytes) < 0) {
+            return (false);
+        }
+        diffs = count_diffs((const int *)ion_buffer.vaddr, read_bytes / sizeof(int));
+    }
+
+    double elapsed = now_seconds() - start;
+
+    printf("%-26s %10.3f ms %8.1f MB/s  diffs %d\n", names[mode], elapsed * 1000.0,
+           read_bytes / elapsed / (1024.0 * 1024.0), diffs);
+
+    /* release the cl buffer before its ion memory */
+    buffer = cl::Buffer();
+
+    return (true);
+}
+
+int main(int argc, const char *argv[])
+{
+    size_t size       = argc > 1 ? strtoul(argv[1], NULL, 0) : 1024 * 1024 * 128;
+    size_t read_bytes = argc > 2 ? strtoul(argv[2], NULL, 0) : size / 4;
+
+    cl::Context context;
+    cl::CommandQueue command_queue;
+    std::vector<cl::Device> devices;
+    cl::Program program;
+
+    if (read_bytes > size) {
+        read_bytes = size;
+    }
+
+    CreateContext(context);
+    GetDeivces(context, devices);
+    CreateCommandQueue(context, command_queue, devices.front());
+
+    std::vector<ClSourceBlob> blobs(1, cl_source_hello);
+
+    if (!CreateProgram(context, devices, blobs, program)) {
+        return -1;
+    }
+
+    cl::Kernel hello_kernel = cl::Kernel(program, "hello");
+
+    printf("buffer %zu bytes, host reads %zu bytes\n", size, read_bytes);
+
+    for (int mode = READ_UNCACHED_MAP; mode <= READ_WRITEBACK_RANGE_SYNC; mode++) {
+        if (!run(context, command_queue, hello_kernel, (ReadMode)mode, size, read_bytes)) {
+            return -2;
+        }
+    }
+
+    return 0;
+}
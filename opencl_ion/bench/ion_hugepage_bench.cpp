@@ -0,0 +1,134 @@
+/*
+ * host-scan throughput of a large buffer on 4 KB and 2 MB pages, for the
+ * ion path (ION_ALLOC_HUGEPAGE) and the CL_MEM_USE_HOST_PTR path
+ * (host_memory_alloc()):
+ *   seq_gbps   - sequential read, like the pclresult check in main.cpp
+ *   page_ns    - one load per 4 KB page in random order, tlb bound
+ *
+ * usage: ion_hugepage_bench [size_bytes] [passes]
+ * runs on the probed backend; only the memfd stand-in honours huge pages.
+ */
+#include "../ion_wrapper.hpp"
+#include "../host_memory.hpp"
+#include "bench_common.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+struct ScanResult {
+    double touch_ms;
+    double seq_gbps;
+    double page_ns;
+};
+
+static ScanResult scan(void *ptr, size_t len, int passes)
+{
+    ScanResult result;
+    long      *data  = (long *)ptr;
+    size_t     count = len / sizeof(long);
+    volatile long sum = 0;
+
+    /* first touch, page faults included */
+    double start = now_seconds();
+
+    for (size_t i = 0; i < count; i++) {
+        data[i] = (long)i;
+    }
+    result.touch_ms = (now_seconds() - start) * 1000.0;
+
+    start = now_seconds();
+
+    for (int p = 0; p < passes; p++) {
+        long local = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            local += data[i];
+        }
+        sum += local;
+    }
+    result.seq_gbps = (double)len * passes / (now_seconds() - start) / 1e9;
+
+    std::vector<size_t> pages(len / 4096);
+
+    for (size_t i = 0; i < pages.size(); i++) {
+        pages[i] = i * (4096 / sizeof(long));
+    }
+    std::shuffle(pages.begin(), pages.end(), std::mt19937(1));
+
+    start = now_seconds();
+
+    for (int p = 0; p < passes; p++) {
+        long local = 0;
+
+        for (size_t i = 0; i < pages.size(); i++) {
+            local += data[pages[i]];
+        }
+        sum += local;
+    }
+    result.page_ns = (now_seconds() - start) * 1e9 / ((double)pages.size() * passes);
+
+    return result;
+}
+
+static void print(const char *name, const char *pages, const ScanResult& result)
+{
+    printf("%-6s %-8s touch %9.3f ms  seq %7.2f GB/s  page %7.2f ns\n",
+           name, pages, result.touch_ms, result.seq_gbps, result.page_ns);
+}
+
+static bool run_ion(size_t size, bool huge_pages, int passes)
+{
+    IonBuffer buffer;
+
+    if (IonAllocator::instance().allocate(size, buffer,
+                                          huge_pages ? ION_ALLOC_HUGEPAGE : 0) < 0) {
+        return (false);
+    }
+
+    /* a 2 MB alignment means the backend found hugetlb pages, else thp decides */
+    print("ion", !huge_pages ? "4k" :
+          (buffer.align == ION_HUGE_PAGE_SIZE ? "hugetlb" : "thp?"),
+          scan(buffer.vaddr, size, passes));
+
+    return (true);
+}
+
+static bool run_host(size_t size, bool huge_pages, int passes)
+{
+    size_t       alloc_len = 0;
+    HostPageSize page_size = HOST_PAGES_SMALL;
+    void        *ptr       = host_memory_alloc(size, huge_pages, &alloc_len, &page_size);
+
+    if (ptr == NULL) {
+        return (false);
+    }
+
+    print("host", host_page_size_name(page_size), scan(ptr, size, passes));
+    host_memory_free(ptr, alloc_len);
+
+    return (true);
+}
+
+int main(int argc, const char *argv[])
+{
+    size_t size   = argc > 1 ? strtoul(argv[1], NULL, 0) : 1024 * 1024 * 128;
+    int    passes = argc > 2 ? atoi(argv[2]) : 4;
+
+    if (!IonAllocator::instance().is_valid()) {
+        return -1;
+    }
+
+    printf("buffer %zu bytes, %d passes\n", size, passes);
+
+    for (int huge = 0; huge <= 1; huge++) {
+        if (!run_ion(size, huge != 0, passes) || !run_host(size, huge != 0, passes)) {
+            fprintf(stderr, "allocate failed\n");
+            return -2;
+        }
+    }
+
+    return 0;
+}
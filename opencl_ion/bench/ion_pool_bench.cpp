@@ -0,0 +1,130 @@
+/*
+ * acquire/release contention on IonBufferPool with 1 to 32 threads. every
+ * thread holds two buffers of different size classes at a time, like a
+ * capture thread handing frames to a worker. prints per thread count:
+ *   ops/sec       - acquire + release pairs per second, all threads
+ *   p50/p99/p999  - latency of one pair in ns
+ * the mutex row is the single-lock pool the lock-free one replaced.
+ *
+ * usage: ion_pool_bench [iterations_per_thread] [max_threads]
+ */
+#include "../ion_pool.hpp"
+#include "bench_common.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const int sizes[] = { 64 * 1024, 256 * 1024 };
+
+/* the previous design: one mutex around per-class vectors */
+class MutexPool {
+public:
+    explicit MutexPool(IonAllocator& allocator) : allocator_(allocator) {}
+
+    int acquire(int size, IonBuffer& ionBuf)
+    {
+        size_t class_size = IonBufferPool::size_class(size);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::vector<IonBuffer>& list = free_lists_[class_size];
+
+            if (!list.empty()) {
+                ionBuf = std::move(list.back());
+                list.pop_back();
+                return 0;
+            }
+        }
+
+        return allocator_.allocate(class_size, ionBuf);
+    }
+
+    void release(IonBuffer& ionBuf)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_lists_[ionBuf.size].push_back(std::move(ionBuf));
+    }
+
+private:
+    IonAllocator& allocator_;
+    std::map<size_t, std::vector<IonBuffer> > free_lists_;
+    std::mutex mutex_;
+};
+
+template <typename Pool>
+static void worker(Pool *pool, int iterations, std::vector<double> *latencies)
+{
+    latencies->reserve(iterations);
+
+    for (int i = 0; i < iterations; i++) {
+        IonBuffer a;
+        IonBuffer b;
+        double    start = now_seconds();
+
+        if ((pool->acquire(sizes[i & 1], a) < 0) || (pool->acquire(sizes[(i + 1) & 1], b) < 0)) {
+            return;
+        }
+        pool->release(a);
+        pool->release(b);
+
+        latencies->push_back((now_seconds() - start) * 1e9);
+    }
+}
+
+template <typename Pool>
+static void run(const char *name, Pool *pool, int threads, int iterations)
+{
+    std::vector<std::vector<double> > latencies(threads);
+    std::vector<std::thread> workers;
+    double start = now_seconds();
+
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::thread(worker<Pool>, pool, iterations, &latencies[t]));
+    }
+
+    for (int t = 0; t < threads; t++) {
+        workers[t].join();
+    }
+
+    double seconds = now_seconds() - start;
+    std::vector<double> all;
+
+    for (int t = 0; t < threads; t++) {
+        all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+    }
+
+    if (all.empty()) {
+        fprintf(stderr, "%s: allocate failed\n", name);
+        return;
+    }
+
+    std::sort(all.begin(), all.end());
+
+    printf("%-9s %2d threads %12.0f ops/sec  p50 %8.0f  p99 %8.0f  p999 %9.0f ns\n",
+           name, threads, all.size() / seconds,
+           all[all.size() / 2], all[all.size() * 99 / 100], all[all.size() * 999 / 1000]);
+}
+
+int main(int argc, const char *argv[])
+{
+    int iterations  = argc > 1 ? atoi(argv[1]) : 100000;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 32;
+
+    if (!IonAllocator::instance().is_valid()) {
+        return -1;
+    }
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        IonBufferPool pool(IonAllocator::instance(), (size_t)1 << 30);
+        MutexPool     mutex_pool(IonAllocator::instance());
+
+        run("lock-free", &pool, threads, iterations);
+        run("mutex", &mutex_pool, threads, iterations);
+    }
+
+    return 0;
+}
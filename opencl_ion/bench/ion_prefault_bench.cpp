@@ -0,0 +1,98 @@
+/*
+ * first-frame latency of a fresh ion buffer with and without pre-faulting:
+ *   lazy          - plain mmap, the first frame takes every page fault
+ *   map_populate  - ION_ALLOC_PREFAULT, faults taken inside allocate()
+ *   prefault      - ion_prefault() right after allocate()
+ *   async         - ion_prefault_async() overlapped with other startup work
+ *
+ * usage: ion_prefault_bench [size_bytes] [startup_work_ms]
+ * runs on the probed backend, i.e. memfd when there is no ion device.
+ */
+#include "../ion_wrapper.hpp"
+#include "bench_common.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+enum PrefaultMode {
+    PREFAULT_LAZY,
+    PREFAULT_MAP_POPULATE,
+    PREFAULT_SYNC,
+    PREFAULT_ASYNC,
+};
+
+/* stand-in for the first frame: the kernel output written by the host */
+static void first_frame(IonBuffer& buffer)
+{
+    int   *data  = (int *)buffer.vaddr;
+    size_t count = buffer.size / sizeof(int);
+
+    for (size_t i = 0; i < count; i++) {
+        data[i] = (int)i;
+    }
+}
+
+static bool run(PrefaultMode mode, size_t size, int startup_work_ms)
+{
+    static const char *names[] = { "lazy", "map_populate", "prefault", "async" };
+
+    IonBuffer buffer;
+    double start = now_seconds();
+
+    if (IonAllocator::instance().allocate(size, buffer,
+                                          mode == PREFAULT_MAP_POPULATE ? ION_ALLOC_PREFAULT : 0) < 0) {
+        return (false);
+    }
+
+    if (mode == PREFAULT_SYNC) {
+        ion_prefault(buffer);
+    }
+
+    std::future<int> warmup;
+
+    if (mode == PREFAULT_ASYNC) {
+        warmup = ion_prefault_async(buffer);
+    }
+    double setup = now_seconds();
+
+    /* context creation, program builds... */
+    std::this_thread::sleep_for(std::chrono::milliseconds(startup_work_ms));
+
+    if (warmup.valid()) {
+        warmup.wait();
+    }
+    double frame_start = now_seconds();
+
+    first_frame(buffer);
+
+    double end = now_seconds();
+
+    printf("%-14s setup %9.3f ms  first frame %9.3f ms  ready after %9.3f ms\n",
+           names[mode], (setup - start) * 1000.0, (end - frame_start) * 1000.0,
+           (end - start) * 1000.0);
+
+    return (true);
+}
+
+int main(int argc, const char *argv[])
+{
+    size_t size         = argc > 1 ? strtoul(argv[1], NULL, 0) : 1024 * 1024 * 128;
+    int startup_work_ms = argc > 2 ? atoi(argv[2]) : 50;
+
+    if (!IonAllocator::instance().is_valid()) {
+        return -1;
+    }
+
+    printf("buffer %zu bytes, %d ms of other startup work\n", size, startup_work_ms);
+
+    for (int mode = PREFAULT_LAZY; mode <= PREFAULT_ASYNC; mode++) {
+        if (!run((PrefaultMode)mode, size, startup_work_ms)) {
+            fprintf(stderr, "allocate failed\n");
+            return -2;
+        }
+    }
+
+    return 0;
+}
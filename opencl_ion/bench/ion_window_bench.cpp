@@ -0,0 +1,105 @@
+/*
+ * streaming scan of a large buffer through a sliding IonWindow against
+ * the same scan over a whole-buffer mapping:
+ *   full    - one mapping of the whole buffer, as without windows
+ *   window  - ION_ALLOC_UNMAPPED plus one window slid across the buffer
+ *
+ * usage: ion_window_bench [size_bytes] [window_bytes]
+ * runs on the probed backend, i.e. memfd when there is no ion device.
+ */
+#include "../ion_wrapper.hpp"
+#include "bench_common.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static long scan(const void *ptr, size_t len)
+{
+    const long *data  = (const long *)ptr;
+    size_t      count = len / sizeof(long);
+    long        sum   = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        sum += data[i];
+    }
+
+    return sum;
+}
+
+int main(int argc, const char *argv[])
+{
+    uint64_t size   = argc > 1 ? strtoull(argv[1], NULL, 0) : (uint64_t)1 << 30;
+    size_t   window = argc > 2 ? strtoul(argv[2], NULL, 0) : 4 * 1024 * 1024;
+
+    /* whole longs per window, so both scans add the same words */
+    window &= ~(sizeof(long) - 1);
+
+    if (!IonAllocator::instance().is_valid() || (window == 0)) {
+        return -1;
+    }
+
+    printf("buffer %llu bytes, window %zu bytes\n", (unsigned long long)size, window);
+
+    IonBuffer buffer;
+
+    if (IonAllocator::instance().allocate(size, buffer, ION_ALLOC_UNMAPPED) < 0) {
+        fprintf(stderr, "allocate failed\n");
+        return -2;
+    }
+
+    /* the "device output": filled through the window too */
+    IonWindow writer;
+    double    start = now_seconds();
+
+    for (uint64_t offset = 0; offset < size; offset += window) {
+        size_t length = (size - offset < window) ? (size_t)(size - offset) : window;
+
+        if (writer.map(buffer, offset, length) < 0) {
+            return -3;
+        }
+        memset(writer.data(), 1, length);
+    }
+    writer.unmap();
+    printf("fill    %9.3f ms\n", (now_seconds() - start) * 1000.0);
+
+    IonWindow reader;
+    long      window_sum = 0;
+
+    start = now_seconds();
+
+    for (uint64_t offset = 0; offset < size; offset += window) {
+        size_t length = (size - offset < window) ? (size_t)(size - offset) : window;
+
+        if (reader.map(buffer, offset, length) < 0) {
+            return -3;
+        }
+        reader.sync(ION_CACHE_INVALIDATE);
+        window_sum += scan(reader.data(), length);
+    }
+    double window_s = now_seconds() - start;
+
+    printf("window  %9.3f ms %7.2f GB/s  host mapping %zu bytes\n",
+           window_s * 1000.0, size / window_s / 1e9, window);
+    reader.unmap();
+
+    /* the whole mapping only fits on 64-bit */
+    if (size <= SIZE_MAX) {
+        IonWindow full;
+
+        start = now_seconds();
+
+        if (full.map(buffer, 0, (size_t)size) < 0) {
+            return -3;
+        }
+        full.sync(ION_CACHE_INVALIDATE);
+        long full_sum = scan(full.data(), (size_t)size);
+        double full_s = now_seconds() - start;
+
+        printf("full    %9.3f ms %7.2f GB/s  host mapping %llu bytes%s\n",
+               full_s * 1000.0, size / full_s / 1e9, (unsigned long long)size,
+               full_sum == window_sum ? "" : "  MISMATCH");
+    }
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * host-side cost of one kernel launch (kernel object, setArg, enqueue)
+ * from several threads sharing a queue:
+ *   by_name    - cl::Kernel(program, "increment") per launch, as main.cpp did
+ *   registry   - KernelRegistry::kernel(handle), one instance per thread
+ * the queue is drained once at the end, so the device time is not counted.
+ *
+ * usage: kernel_launch_bench [launches_per_thread] [threads]
+ */
+#include "../ocl/cl_wrapper.hpp"
+#include "../ocl/cl_kernel_registry.hpp"
+#include "../gen/cl_sources.hpp"
+#include "bench_common.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+static const size_t work_items = 1024;
+
+static void launch_by_name(cl::Program& program, cl::CommandQueue& command_queue,
+                           cl::Buffer& buffer, int launches)
+{
+    for (int i = 0; i < launches; i++) {
+        cl::Kernel kernel(program, "increment");
+
+        kernel.setArg(0, buffer);
+        command_queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(work_items),
+                                           cl::NullRange, NULL, NULL);
+    }
+}
+
+static void launch_registry(KernelRegistry& kernels, int handle, cl::CommandQueue& command_queue,
+                            cl::Buffer& buffer, int launches)
+{
+    for (int i = 0; i < launches; i++) {
+        cl::Kernel *kernel = kernels.kernel(handle);
+
+        kernel->setArg(0, buffer);
+        command_queue.enqueueNDRangeKernel(*kernel, cl::NullRange, cl::NDRange(work_items),
+                                           cl::NullRange, NULL, NULL);
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    int launches = (argc > 1) ? atoi(argv[1]) : 10000;
+    int threads  = (argc > 2) ? atoi(argv[2]) : 4;
+
+    cl::Context context;
+    cl::CommandQueue command_queue;
+    std::vector<cl::Device> devices;
+    cl::Program program;
+
+    CreateContext(context);
+    GetDeivces(context, devices);
+    CreateCommandQueue(context, command_queue, devices.front());
+
+    std::vector<ClSourceBlob> blobs(1, cl_source_bench);
+
+    if (!CreateProgram(context, devices, blobs, program)) {
+        return -1;
+    }
+
+    KernelRegistry kernels;
+
+    if (!kernels.init(program, devices.front())) {
+        return -1;
+    }
+
+    int handle = kernels.lookup("increment");
+    const KernelInfo *info = kernels.info(handle);
+
+    printf("# increment: work_group_size %zu, multiple %zu, clone %s\n",
+           info->work_group_size, info->preferred_multiple,
+           kernels.uses_clone() ? "yes" : "no");
+
+    /* one buffer per thread, so launches of different threads do not depend
+       on each other */
+    std::vector<cl::Buffer> buffers;
+
+    for (int t = 0; t < threads; t++) {
+        buffers.push_back(cl::Buffer(context, CL_MEM_READ_WRITE, work_items * sizeof(int)));
+    }
+
+    printf("%-10s %8s %12s\n", "path", "threads", "us/launch");
+
+    for (int mode = 0; mode < 2; mode++) {
+        std::vector<std::thread> workers;
+        double start = now_seconds();
+
+        for (int t = 0; t < threads; t++) {
+            if (mode == 0) {
+                workers.push_back(std::thread(launch_by_name, std::ref(program),
+                                              std::ref(command_queue), std::ref(buffers[t]), launches));
+            } else {
+                workers.push_back(std::thread(launch_registry, std::ref(kernels), handle,
+                                              std::ref(command_queue), std::ref(buffers[t]), launches));
+            }
+        }
+
+        for (size_t t = 0; t < workers.size(); t++) {
+            workers[t].join();
+        }
+
+        double elapsed = now_seconds() - start;
+        command_queue.finish();
+
+        printf("%-10s %8d %12.2f\n", mode ? "registry" : "by_name", threads,
+               elapsed * 1e6 / ((double)launches * threads));
+    }
+
+    return 0;
+}
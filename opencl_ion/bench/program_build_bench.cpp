@@ -0,0 +1,159 @@
+/*
+ * cold-start critical path of a startup that builds several programs and
+ * allocates its buffers, with the builds done one after another on the
+ * main thread (serial) or through CreateProgramAsync() while the queue and
+ * the buffers are set up (async):
+ *   build_ms   - time until every program is built
+ *   setup_ms   - command queue, BufferFactory init, buffer create and fill
+ *   total_ms   - the critical path, context creation included
+ *
+ * every program gets a fresh -D so driver side caches do not hit, the
+ * binary cache (cl_program_cache.hpp) is not used.
+ *
+ * programs come from the embedded gen/cl_sources.hpp, so neither path
+ * reads files.
+ *
+ * usage: program_build_bench [programs] [buffer_bytes] [runs]
+ */
+#include "../buffer_factory.hpp"
+#include "../ocl/cl_wrapper.hpp"
+#include "../gen/cl_sources.hpp"
+#include "bench_common.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct StartupTiming {
+    double build_ms;
+    double setup_ms;
+    double total_ms;
+};
+
+static std::vector<ClSourceBlob> program_blobs(int index)
+{
+    return std::vector<ClSourceBlob>(1, (index % 2) ? cl_source_bench : cl_source_hello);
+}
+
+static std::string program_options(int run, int index)
+{
+    char options[64];
+    snprintf(options, sizeof(options), "-D PROGRAM_BUILD_SALT=%d", run * 1000 + index);
+
+    return std::string(options);
+}
+
+static bool setup(cl::Context& context, cl::Device& device, size_t size,
+                  cl::CommandQueue& command_queue, BufferFactory& factory,
+                  ZeroCopyBuffer& buffer)
+{
+    if (!CreateCommandQueue(context, command_queue, device)) {
+        return (false);
+    }
+
+    factory.init(context, device);
+
+    if (!factory.create(size, ACCESS_HOST_WRITE_DEVICE_READ, buffer)) {
+        return (false);
+    }
+
+    /* the first frame, page faults included */
+    void *data = buffer.begin_host_access(command_queue, CL_MAP_WRITE);
+
+    if (data == NULL) {
+        return (false);
+    }
+    memset(data, 1, size);
+
+    return (buffer.end_host_access(command_queue, data));
+}
+
+static bool run(bool async, int run_index, int programs, size_t size, StartupTiming& timing)
+{
+    double start = now_seconds();
+
+    cl::Context context;
+    std::vector<cl::Device> devices;
+
+    CreateContext(context);
+
+    if (!GetDeivces(context, devices) || devices.empty()) {
+        return (false);
+    }
+
+    std::vector<cl::Program> built(programs);
+    cl::CommandQueue command_queue;
+    BufferFactory factory;
+    ZeroCopyBuffer buffer;
+    bool success = true;
+
+    double build_start = now_seconds();
+
+    if (async) {
+        std::vector<std::future<bool> > futures;
+
+        for (int i = 0; i < programs; i++) {
+            futures.push_back(CreateProgramAsync(context, devices, program_blobs(i), built[i],
+                                                 NULL, program_options(run_index, i)));
+        }
+
+        double setup_start = now_seconds();
+        success = setup(context, devices.front(), size, command_queue, factory, buffer);
+        timing.setup_ms = (now_seconds() - setup_start) * 1000.0;
+
+        for (size_t i = 0; i < futures.size(); i++) {
+            success = futures[i].get() && success;
+        }
+        timing.build_ms = (now_seconds() - build_start) * 1000.0;
+    } else {
+        for (int i = 0; success && (i < programs); i++) {
+            success = CreateProgram(context, devices, program_blobs(i), built[i],
+                                    NULL, program_options(run_index, i));
+        }
+        timing.build_ms = (now_seconds() - build_start) * 1000.0;
+
+        double setup_start = now_seconds();
+        success = success && setup(context, devices.front(), size, command_queue, factory, buffer);
+        timing.setup_ms = (now_seconds() - setup_start) * 1000.0;
+    }
+
+    timing.total_ms = (now_seconds() - start) * 1000.0;
+
+    return (success);
+}
+
+int main(int argc, const char *argv[])
+{
+    int    programs = (argc > 1) ? atoi(argv[1]) : 4;
+    size_t size     = (argc > 2) ? strtoul(argv[2], NULL, 0) : 32 * 1024 * 1024;
+    int    runs     = (argc > 3) ? atoi(argv[3]) : 3;
+
+    StartupTiming best[2];
+
+    for (int mode = 0; mode < 2; mode++) {
+        best[mode].build_ms = best[mode].setup_ms = best[mode].total_ms = 1e30;
+
+        for (int r = 0; r < runs; r++) {
+            StartupTiming timing;
+
+            /* salts differ per mode and run, so every build is cold */
+            if (!run(mode == 1, mode * runs + r, programs, size, timing)) {
+                fprintf(stderr, "%s startup failed\n", mode ? "async" : "serial");
+                return -1;
+            }
+
+            if (timing.total_ms < best[mode].total_ms) {
+                best[mode] = timing;
+            }
+        }
+    }
+
+    printf("%-8s %10s %10s %10s\n", "mode", "build_ms", "setup_ms", "total_ms");
+    printf("%-8s %10.2f %10.2f %10.2f\n", "serial", best[0].build_ms, best[0].setup_ms, best[0].total_ms);
+    printf("%-8s %10.2f %10.2f %10.2f\n", "async", best[1].build_ms, best[1].setup_ms, best[1].total_ms);
+    printf("# %d programs, %zu byte buffer: critical path %.2f ms shorter (%.0f%%)\n",
+           programs, size, best[0].total_ms - best[1].total_ms,
+           100.0 * (best[0].total_ms - best[1].total_ms) / best[0].total_ms);
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * startup cost of getting one built program, mean over the runs:
+ *   source  - OpenCL C compiled from the embedded text
+ *   il      - SPIR-V from "make spirv" through CreateProgramFromIL(), n/a
+ *             when a run fell back to the sources
+ *   cached  - binaries loaded from a ProgramCache
+ * source runs get a fresh -D each, so the driver cannot reuse a build; il
+ * modules take no -D, a driver side cache may make il look cheaper.
+ *
+ * usage: program_load_bench [il_file] [runs]
+ * defaults to gen/box_filter.spv; run from opencl_ion/.
+ */
+#include "../ocl/cl_wrapper.hpp"
+#include "../ocl/cl_program_cache.hpp"
+#include "../gen/cl_sources.hpp"
+#include "bench_common.hpp"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* remove the cache files and the directory, the cache makes no subdirectories */
+static bool remove_directory(const std::string& directory)
+{
+    DIR *dir = opendir(directory.c_str());
+
+    if (dir == NULL) {
+        return false;
+    }
+
+    struct dirent *ent;
+    bool           removed = true;
+
+    while ((ent = readdir(dir)) != NULL) {
+        std::string name = ent->d_name;
+
+        if ((name != ".") && (name != "..") && (unlink((directory + "/" + name).c_str()) < 0)) {
+            perror(name.c_str());
+            removed = false;
+        }
+    }
+    closedir(dir);
+
+    return removed && (rmdir(directory.c_str()) == 0);
+}
+
+int main(int argc, const char *argv[])
+{
+    std::string il_file = (argc > 1) ? argv[1] : "gen/box_filter.spv";
+    int         runs    = (argc > 2) ? atoi(argv[2]) : 5;
+
+    cl::Context context;
+    std::vector<cl::Device> devices;
+
+    CreateContext(context);
+    GetDeivces(context, devices);
+
+    std::vector<ClSourceBlob> blobs(1, cl_source_box_filter);
+    double source_ms = 0, il_ms = 0, cached_ms = 0;
+    bool   il_used = IsILSupported(devices) && (access(il_file.c_str(), R_OK) == 0);
+
+    for (int r = 0; r < runs; r++) {
+        cl::Program program;
+        char options[64];
+
+        snprintf(options, sizeof(options), "-D PROGRAM_LOAD_SALT=%d", r);
+
+        double start = now_seconds();
+
+        if (!CreateProgram(context, devices, blobs, program, NULL, options)) {
+            fprintf(stderr, "source build failed\n");
+            return -1;
+        }
+        source_ms += (now_seconds() - start) * 1000.0;
+    }
+
+    /* the driver may still reject the module, then the run built from source */
+    for (int r = 0; il_used && (r < runs); r++) {
+        cl::Program program;
+        double start = now_seconds();
+
+        if (!CreateProgramFromIL(context, devices, il_file, blobs, program, NULL, "", &il_used)) {
+            fprintf(stderr, "il build failed\n");
+            return -1;
+        }
+        il_ms += (now_seconds() - start) * 1000.0;
+    }
+
+    /* a private directory, so earlier runs do not count */
+    char directory[] = "/tmp/program_load_bench.XXXXXX";
+
+    if (mkdtemp(directory) == NULL) {
+        perror("mkdtemp");
+        return -1;
+    }
+
+    ProgramCache cache(directory);
+    cl::Program  warm;
+
+    if (!CreateProgram(context, devices, blobs, warm, &cache)) {
+        fprintf(stderr, "cache warm-up failed\n");
+        return -1;
+    }
+
+    for (int r = 0; r < runs; r++) {
+        cl::Program program;
+        double start = now_seconds();
+
+        if (!CreateProgram(context, devices, blobs, program, &cache)) {
+            fprintf(stderr, "cached load failed\n");
+            return -1;
+        }
+        cached_ms += (now_seconds() - start) * 1000.0;
+    }
+
+    printf("%-8s %10s\n", "path", "ms");
+    printf("%-8s %10.2f\n", "source", source_ms / runs);
+
+    if (il_used) {
+        printf("%-8s %10.2f\n", "il", il_ms / runs);
+    } else {
+        printf("%-8s %10s\n", "il", "n/a");
+    }
+    printf("%-8s %10.2f\n", "cached", cached_ms / runs);
+    printf("# cache hits %u of %d\n", cache.hits(), runs);
+
+    return remove_directory(directory) ? 0 : -1;
+}
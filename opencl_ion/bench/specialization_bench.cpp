@@ -0,0 +1,141 @@
+/*
+ * generic vs specialized builds of cl/box_filter.cl (ProgramVariants):
+ *   generic      - geometry passed as kernel arguments
+ *   specialized  - WIDTH/HEIGHT/STRIDE/CHANNELS as -D constants
+ *   spec+fast    - the same with BUILD_PRESET_FAST
+ * per variant: build_ms (first get()), lookup_us (a later get()) and
+ * kernel_ms (device time from profiling events, mean over the runs).
+ * the outputs of all variants are compared with the generic one.
+ *
+ * usage: specialization_bench [width] [height] [channels] [runs]
+ */
+#include "../ocl/cl_wrapper.hpp"
+#include "../ocl/cl_program_variants.hpp"
+#include "../gen/cl_sources.hpp"
+#include "bench_common.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct VariantTiming {
+    double build_ms;
+    double lookup_us;
+    double kernel_ms;
+};
+
+static bool run_kernel(cl::CommandQueue& command_queue, cl::Program& program,
+                       cl::Buffer& src, cl::Buffer& dst,
+                       int width, int height, int channels, int runs,
+                       double& kernel_ms)
+{
+    cl_int error_number = 0;
+    cl::Kernel kernel(program, "box3x3", &error_number);
+
+    if (error_number != CL_SUCCESS) {
+        return (false);
+    }
+
+    kernel.setArg(0, src);
+    kernel.setArg(1, dst);
+    kernel.setArg(2, width);
+    kernel.setArg(3, height);
+    kernel.setArg(4, width * channels);
+    kernel.setArg(5, channels);
+
+    kernel_ms = 0;
+
+    for (int r = 0; r < runs; r++) {
+        cl::Event event;
+        cl_ulong  start = 0, end = 0;
+
+        command_queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width, height),
+                                           cl::NullRange, NULL, &event);
+        event.wait();
+        event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
+        event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
+        kernel_ms += (end - start) / 1e6;
+    }
+    kernel_ms /= runs;
+
+    return (true);
+}
+
+int main(int argc, const char *argv[])
+{
+    int width    = (argc > 1) ? atoi(argv[1]) : 1920;
+    int height   = (argc > 2) ? atoi(argv[2]) : 1080;
+    int channels = (argc > 3) ? atoi(argv[3]) : 4;
+    int runs     = (argc > 4) ? atoi(argv[4]) : 20;
+    size_t size  = (size_t)width * height * channels;
+
+    cl::Context context;
+    cl::CommandQueue command_queue;
+    std::vector<cl::Device> devices;
+
+    CreateContext(context);
+    GetDeivces(context, devices);
+    CreateCommandQueue(context, command_queue, devices.front());
+
+    std::vector<std::string> sources(1, std::string(cl_source_box_filter.text,
+                                                    cl_source_box_filter.size));
+    ProgramVariants variants(context, devices, sources);
+
+    SpecializationConstants constants;
+    constants["WIDTH"]    = std::to_string(width);
+    constants["HEIGHT"]   = std::to_string(height);
+    constants["STRIDE"]   = std::to_string(width * channels);
+    constants["CHANNELS"] = std::to_string(channels);
+
+    static const char *names[] = { "generic", "specialized", "spec+fast" };
+    SpecializationConstants variant_constants[] = {
+        SpecializationConstants(), constants, constants
+    };
+    unsigned int variant_presets[] = {
+        BUILD_PRESET_NONE, BUILD_PRESET_NONE, BUILD_PRESET_FAST
+    };
+
+    std::vector<unsigned char> input(size), reference(size), output(size);
+
+    for (size_t i = 0; i < size; i++) {
+        input[i] = (unsigned char)(i * 31 + (i >> 7));
+    }
+
+    cl::Buffer src(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, size, &input[0]);
+    cl::Buffer dst(context, CL_MEM_WRITE_ONLY, size);
+
+    printf("%-12s %10s %10s %10s %8s\n", "variant", "build_ms", "lookup_us", "kernel_ms", "match");
+
+    for (int v = 0; v < 3; v++) {
+        VariantTiming timing;
+        cl::Program   program;
+
+        double start = now_seconds();
+
+        if (!variants.get(variant_constants[v], variant_presets[v], program)) {
+            fprintf(stderr, "%s: build failed\n", names[v]);
+            return -1;
+        }
+        timing.build_ms = (now_seconds() - start) * 1000.0;
+
+        start = now_seconds();
+        variants.get(variant_constants[v], variant_presets[v], program);
+        timing.lookup_us = (now_seconds() - start) * 1e6;
+
+        if (!run_kernel(command_queue, program, src, dst, width, height, channels, runs,
+                        timing.kernel_ms)) {
+            fprintf(stderr, "%s: kernel failed\n", names[v]);
+            return -1;
+        }
+
+        std::vector<unsigned char>& result = (v == 0) ? reference : output;
+        command_queue.enqueueReadBuffer(dst, CL_TRUE, 0, size, &result[0]);
+
+        printf("%-12s %10.2f %10.2f %10.3f %8s\n", names[v], timing.build_ms, timing.lookup_us,
+               timing.kernel_ms, (v == 0 || memcmp(&reference[0], &output[0], size) == 0) ? "yes" : "NO");
+    }
+
+    printf("# %dx%dx%d, %zu variants cached\n", width, height, channels, variants.size());
+
+    return 0;
+}
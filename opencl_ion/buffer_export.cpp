@@ -0,0 +1,205 @@
+#include "buffer_export.hpp"
+
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <vector>
+
+struct FrameHeader {
+    uint64_t offset;
+    uint64_t size;
+};
+
+static void CL_CALLBACK signal_fence(cl_event, cl_int status, void *user_data)
+{
+    int      fence_fd = (int)(intptr_t)user_data;
+    uint64_t value    = (status < 0) ? EXPORT_FENCE_ERROR : EXPORT_FENCE_COMPLETE;
+    ssize_t  ret      = write(fence_fd, &value, sizeof(value));
+
+    (void)ret;
+    close(fence_fd);
+}
+
+bool ExportBuffer(cl::CommandQueue  command_queue,
+                  const cl::Buffer& buffer,
+                  ExportedFrame   & frame)
+{
+    int    buffer_fd = -1;
+    size_t offset    = 0;
+    size_t size      = 0;
+
+    frame.fd       = -1;
+    frame.fence_fd = -1;
+
+    if (!GetIonBufferFd(buffer, &buffer_fd, &offset, &size)) {
+        CL_WARN("buffer is not backed by ion memory ");
+        return (false);
+    }
+
+    cl::Event done;
+
+    if (command_queue.enqueueMarker(&done) < 0) {
+        CL_WARN("Failed to enqueue export marker ");
+        return (false);
+    }
+
+    frame.fd       = dup(buffer_fd);
+    frame.fence_fd = eventfd(0, EFD_CLOEXEC);
+    frame.offset   = offset;
+    frame.size     = size;
+
+    /* the callback owns its own copy of the fence */
+    int callback_fd = (frame.fence_fd >= 0) ? dup(frame.fence_fd) : -1;
+
+    if ((frame.fd < 0) || (callback_fd < 0)) {
+        CL_WARN("Failed to create export fds ");
+        if (callback_fd >= 0) {
+            close(callback_fd);
+        }
+        CloseExportedFrame(frame);
+        return (false);
+    }
+
+    if (done.setCallback(CL_COMPLETE, signal_fence, (void *)(intptr_t)callback_fd) < 0) {
+        CL_WARN("Failed to set export fence callback ");
+        close(callback_fd);
+        CloseExportedFrame(frame);
+        return (false);
+    }
+
+    command_queue.flush();
+
+    return (true);
+}
+
+void CloseExportedFrame(ExportedFrame& frame)
+{
+    if (frame.fd >= 0) {
+        close(frame.fd);
+    }
+
+    if (frame.fence_fd >= 0) {
+        close(frame.fence_fd);
+    }
+
+    frame.fd       = -1;
+    frame.fence_fd = -1;
+}
+
+bool SendExportedFrame(int socket_fd, const ExportedFrame& frame)
+{
+    FrameHeader header;
+    header.offset = frame.offset;
+    header.size   = frame.size;
+
+    struct iovec iov;
+    iov.iov_base = &header;
+    iov.iov_len  = sizeof(header);
+
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(2 * sizeof(int));
+
+    int fds[2] = { frame.fd, frame.fence_fd };
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    return (sendmsg(socket_fd, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(header));
+}
+
+bool ReceiveExportedFrame(int socket_fd, ExportedFrame& frame)
+{
+    FrameHeader header;
+
+    struct iovec iov;
+    iov.iov_base = &header;
+    iov.iov_len  = sizeof(header);
+
+    char control[CMSG_SPACE(2 * sizeof(int))];
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    frame.fd       = -1;
+    frame.fence_fd = -1;
+
+    ssize_t received = recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC);
+
+    if (received < 0) {
+        return (false);
+    }
+
+    /* every fd the kernel installed, whatever the shape of the message */
+    std::vector<int> fds;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if ((cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS) ||
+            (cmsg->cmsg_len < CMSG_LEN(0))) {
+            continue;
+        }
+
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+        for (size_t i = 0; i < count; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+            fds.push_back(fd);
+        }
+    }
+
+    /* a truncated or unexpected message still hands over fds, close them */
+    if ((received != (ssize_t)sizeof(header)) || (msg.msg_flags & (MSG_CTRUNC | MSG_TRUNC)) ||
+        (fds.size() != 2)) {
+        for (size_t i = 0; i < fds.size(); i++) {
+            close(fds[i]);
+        }
+        return (false);
+    }
+
+    frame.fd       = fds[0];
+    frame.fence_fd = fds[1];
+    frame.offset   = header.offset;
+    frame.size     = header.size;
+
+    return (true);
+}
+
+int WaitExportedFrame(const ExportedFrame& frame, int timeout_ms)
+{
+    struct pollfd pfd;
+    pfd.fd     = frame.fence_fd;
+    pfd.events = POLLIN;
+
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return -2;
+    }
+
+    uint64_t value = 0;
+
+    if ((read(frame.fence_fd, &value, sizeof(value)) != sizeof(value))) {
+        return -1;
+    }
+
+    /* reading clears an eventfd, put the value back for other waiters */
+    ssize_t ret = write(frame.fence_fd, &value, sizeof(value));
+    (void)ret;
+
+    return (value == EXPORT_FENCE_COMPLETE) ? 0 : -1;
+}
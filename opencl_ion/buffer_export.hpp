@@ -0,0 +1,66 @@
+#ifndef __BUFFER_EXPORT_HPP__
+#define __BUFFER_EXPORT_HPP__
+
+#include "ion_cl.hpp"
+
+#define EXPORT_FENCE_COMPLETE 1 // value of a signalled fence
+#define EXPORT_FENCE_ERROR    2 // the commands writing the buffer failed
+
+/**
+ * an output buffer handed to another process: the buffer fd, the range of
+ * the frame in it and a fence that becomes readable when the device is
+ * done. both fds are owned by the frame.
+ *
+ * a consumer reading write-back cached memory on the cpu must invalidate
+ * (DMA_BUF_IOCTL_SYNC) after the fence.
+ */
+struct ExportedFrame {
+    int    fd;
+    size_t offset;
+    size_t size;
+    int    fence_fd; // eventfd, reads EXPORT_FENCE_COMPLETE or EXPORT_FENCE_ERROR
+};
+
+/**
+ * export a buffer made by CreateIonBuffer() (or a sub-buffer of one) with a
+ * fence on all commands enqueued so far
+ * @param  command_queue [queue the producing kernels were enqueued on]
+ * @param  buffer        [ion backed buffer]
+ * @param  frame         [return frame, close with CloseExportedFrame()]
+ * @return               [true for success]
+ */
+bool ExportBuffer(cl::CommandQueue  command_queue,
+                  const cl::Buffer& buffer,
+                  ExportedFrame   & frame);
+
+/**
+ * close the fds of a frame
+ * @param  frame [exported or received frame]
+ */
+void CloseExportedFrame(ExportedFrame& frame);
+
+/**
+ * send a frame over a unix socket (SCM_RIGHTS), the frame stays owned by
+ * the caller
+ * @param  socket_fd [connected unix socket]
+ * @param  frame     [frame to send]
+ * @return           [true for success]
+ */
+bool SendExportedFrame(int socket_fd, const ExportedFrame& frame);
+
+/**
+ * @param  socket_fd [connected unix socket]
+ * @param  frame     [return frame, close with CloseExportedFrame()]
+ * @return           [true for success]
+ */
+bool ReceiveExportedFrame(int socket_fd, ExportedFrame& frame);
+
+/**
+ * consumer side wait on the fence of a frame
+ * @param  frame      [received frame]
+ * @param  timeout_ms [-1 to wait forever]
+ * @return            [0 complete, -1 device error, -2 timeout]
+ */
+int WaitExportedFrame(const ExportedFrame& frame, int timeout_ms);
+
+#endif // ifndef __BUFFER_EXPORT_HPP__
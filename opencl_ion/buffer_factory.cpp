@@ -0,0 +1,434 @@
+#include "buffer_factory.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <utility>
+
+/* host memory behind a CL_MEM_USE_HOST_PTR buffer, freed with the cl_mem */
+struct HostMemory {
+    void *ptr;
+    size_t mmap_len; // host_memory_alloc() memory if non-zero
+#ifdef CL_VERSION_2_0
+    cl_context svm_context; // set for svm memory
+#endif
+};
+
+static void CL_CALLBACK free_host_memory(cl_mem, void *user_data)
+{
+    HostMemory *memory = (HostMemory *)user_data;
+
+#ifdef CL_VERSION_2_0
+    if (memory->svm_context != NULL) {
+        clSVMFree(memory->svm_context, memory->ptr);
+        clReleaseContext(memory->svm_context);
+        delete memory;
+        return;
+    }
+#endif
+
+    if (memory->mmap_len > 0) {
+        host_memory_free(memory->ptr, memory->mmap_len);
+    } else {
+        ::free(memory->ptr);
+    }
+    delete memory;
+}
+
+static size_t align_up(size_t value, size_t align)
+{
+    return (value + align - 1) / align * align;
+}
+
+ZeroCopyBuffer::~ZeroCopyBuffer()
+{
+    release();
+}
+
+void ZeroCopyBuffer::release()
+{
+    /* host access left open */
+    if ((config_.alloc_type != BUFFER_ALLOC_SVM) && (mapped_ptr_ != NULL)) {
+        map_queue_.enqueueUnmapMemObject(buffer_, mapped_ptr_);
+    }
+
+    /* the cl buffer must go before the ion memory behind it */
+    buffer_     = cl::Buffer();
+    map_queue_  = cl::CommandQueue();
+    mapped_ptr_ = NULL;
+}
+
+ZeroCopyBuffer::ZeroCopyBuffer(ZeroCopyBuffer&& other) noexcept
+    : ion_(std::move(other.ion_)),
+      buffer_(other.buffer_),
+      config_(other.config_),
+      size_(other.size_),
+      map_flags_(other.map_flags_),
+      mapped_ptr_(other.mapped_ptr_),
+      map_queue_(other.map_queue_)
+{
+    other.buffer_     = cl::Buffer();
+    other.map_queue_  = cl::CommandQueue();
+    other.mapped_ptr_ = NULL;
+    other.size_       = 0;
+}
+
+ZeroCopyBuffer& ZeroCopyBuffer::operator=(ZeroCopyBuffer&& other) noexcept
+{
+    if (this != &other) {
+        release();
+        ion_              = std::move(other.ion_);
+        buffer_           = other.buffer_;
+        config_           = other.config_;
+        size_             = other.size_;
+        map_flags_        = other.map_flags_;
+        mapped_ptr_       = other.mapped_ptr_;
+        map_queue_        = other.map_queue_;
+        other.buffer_     = cl::Buffer();
+        other.map_queue_  = cl::CommandQueue();
+        other.mapped_ptr_ = NULL;
+        other.size_       = 0;
+    }
+
+    return *this;
+}
+
+void *ZeroCopyBuffer::begin_host_access(cl::CommandQueue& command_queue, cl_map_flags flags)
+{
+    map_flags_ = flags;
+
+    /* fine-grain svm is coherent */
+    if (config_.alloc_type == BUFFER_ALLOC_SVM) {
+        return (mapped_ptr_);
+    }
+
+    if (config_.alloc_type == BUFFER_ALLOC_ION_HOST_PTR) {
+        if ((config_.host_cache_policy == CL_MEM_HOST_WRITEBACK_QCOM) &&
+            (flags & CL_MAP_READ) &&
+            (ion_cache_sync(ion_, ION_CACHE_INVALIDATE) < 0)) {
+            return (NULL);
+        }
+        return (ion_.vaddr);
+    }
+
+    /* the map is the sync point; without unified memory it copies the
+       device data back */
+    cl_int error_number = 0;
+    void  *host_ptr     = command_queue.enqueueMapBuffer(buffer_, CL_TRUE, flags, 0, size_,
+                                                         NULL, NULL, &error_number);
+
+    if (error_number < 0) {
+        CL_WARN("Failed to map buffer: " + ErrorNumberToString(error_number) + " ");
+        return (NULL);
+    }
+
+    /* remembered so release() can unmap an access left open */
+    mapped_ptr_ = host_ptr;
+    map_queue_  = command_queue;
+
+    return (host_ptr);
+}
+
+bool ZeroCopyBuffer::end_host_access(cl::CommandQueue& command_queue, void *host_ptr)
+{
+    if (config_.alloc_type == BUFFER_ALLOC_ION_HOST_PTR) {
+        if ((config_.host_cache_policy == CL_MEM_HOST_WRITEBACK_QCOM) &&
+            (map_flags_ & CL_MAP_WRITE)) {
+            return (ion_cache_sync(ion_, ION_CACHE_CLEAN) == 0);
+        }
+        return (true);
+    }
+
+    if (config_.alloc_type == BUFFER_ALLOC_SVM) {
+        return (true);
+    }
+
+    /* kernels must not run on a mapped buffer, and the unmap carries host
+       writes to the device */
+    mapped_ptr_ = NULL;
+    map_queue_  = cl::CommandQueue();
+
+    return (command_queue.enqueueUnmapMemObject(buffer_, host_ptr) == CL_SUCCESS);
+}
+
+BufferFactory::BufferFactory()
+    : ion_supported_(false), iocoherent_supported_(false), svm_supported_(false),
+    unified_memory_(false), host_ptr_align_(4096), huge_page_threshold_(0),
+    strategy_(BUFFER_ALLOC_HOST_PTR), portable_strategy_(BUFFER_ALLOC_HOST_PTR)
+{
+    for (int i = 0; i < ACCESS_PATTERN_COUNT; i++) {
+        defaults_[i].alloc_type        = BUFFER_ALLOC_HOST_PTR;
+        defaults_[i].host_cache_policy = CL_MEM_HOST_UNCACHED_QCOM;
+    }
+}
+
+bool BufferFactory::init(cl::Context context, cl::Device device)
+{
+    context_              = context;
+    ion_supported_        = IsExtensionSupported(device, "cl_qcom_ion_host_ptr");
+    iocoherent_supported_ = IsExtensionSupported(device, "cl_qcom_ext_host_ptr_iocoherent");
+    svm_supported_        = false;
+
+#ifdef CL_VERSION_2_0
+    cl_device_svm_capabilities svm_caps = 0;
+
+    /* opencl 1.x devices reject the query */
+    if ((clGetDeviceInfo(device(), CL_DEVICE_SVM_CAPABILITIES, sizeof(svm_caps),
+                         &svm_caps, NULL) == CL_SUCCESS) &&
+        (svm_caps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER)) {
+        svm_supported_ = true;
+    }
+#endif
+
+    cl_bool unified_memory = CL_FALSE;
+    cl_uint cacheline      = 0;
+    cl_uint align_bits     = 0;
+
+    device.getInfo(CL_DEVICE_HOST_UNIFIED_MEMORY, &unified_memory);
+    device.getInfo(CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE, &cacheline);
+    device.getInfo(CL_DEVICE_MEM_BASE_ADDR_ALIGN, &align_bits);
+    unified_memory_ = (unified_memory == CL_TRUE);
+
+    /* drivers only skip the copy for page and cache line aligned host memory */
+    host_ptr_align_ = sysconf(_SC_PAGESIZE);
+
+    if (cacheline > host_ptr_align_) {
+        host_ptr_align_ = cacheline;
+    }
+
+    if (align_bits / 8 > host_ptr_align_) {
+        host_ptr_align_ = align_bits / 8;
+    }
+
+    if (svm_supported_) {
+        portable_strategy_ = BUFFER_ALLOC_SVM;
+    } else if (unified_memory_) {
+        portable_strategy_ = BUFFER_ALLOC_USE_HOST_PTR;
+    } else {
+        portable_strategy_ = BUFFER_ALLOC_HOST_PTR;
+    }
+
+    strategy_ = ion_supported_ ? BUFFER_ALLOC_ION_HOST_PTR : portable_strategy_;
+
+    INFO("zero-copy strategy: %s", BufferAllocTypeToString(strategy_));
+
+    if (!ion_supported_) {
+        for (int i = 0; i < ACCESS_PATTERN_COUNT; i++) {
+            defaults_[i].alloc_type = strategy_;
+        }
+        return (true);
+    }
+
+    /*
+     * provisional, from the expected cost of each policy until
+     * bench/buffer_policy_bench has been swept on the target:
+     * host writes stream through write-combining and need no clean;
+     * host reads want cached lines, io-coherent spares the invalidate;
+     * ping-pong pays maintenance both ways, so io-coherent or uncached.
+     */
+    defaults_[ACCESS_HOST_WRITE_DEVICE_READ].alloc_type        = BUFFER_ALLOC_ION_HOST_PTR;
+    defaults_[ACCESS_HOST_WRITE_DEVICE_READ].host_cache_policy = CL_MEM_HOST_WRITE_COMBINING_QCOM;
+
+    defaults_[ACCESS_DEVICE_WRITE_HOST_READ].alloc_type        = BUFFER_ALLOC_ION_HOST_PTR;
+    defaults_[ACCESS_DEVICE_WRITE_HOST_READ].host_cache_policy =
+        iocoherent_supported_ ? CL_MEM_HOST_IOCOHERENT_QCOM : CL_MEM_HOST_WRITEBACK_QCOM;
+
+    defaults_[ACCESS_PING_PONG].alloc_type        = BUFFER_ALLOC_ION_HOST_PTR;
+    defaults_[ACCESS_PING_PONG].host_cache_policy =
+        iocoherent_supported_ ? CL_MEM_HOST_IOCOHERENT_QCOM : CL_MEM_HOST_UNCACHED_QCOM;
+
+    return (true);
+}
+
+BufferConfig BufferFactory::default_config(BufferAccessPattern pattern) const
+{
+    return (defaults_[pattern]);
+}
+
+void BufferFactory::set_default_config(BufferAccessPattern pattern, const BufferConfig& config)
+{
+    defaults_[pattern] = config;
+}
+
+bool BufferFactory::is_supported(const BufferConfig& config) const
+{
+    if (config.alloc_type == BUFFER_ALLOC_SVM) {
+        return (svm_supported_);
+    }
+
+    if (config.alloc_type != BUFFER_ALLOC_ION_HOST_PTR) {
+        return (true);
+    }
+
+    if (!ion_supported_) {
+        return (false);
+    }
+
+    return ((config.host_cache_policy != CL_MEM_HOST_IOCOHERENT_QCOM) || iocoherent_supported_);
+}
+
+bool BufferFactory::create(size_t size, BufferAccessPattern pattern, ZeroCopyBuffer& buffer)
+{
+    cl_mem_flags flags = CL_MEM_READ_WRITE;
+
+    if (pattern == ACCESS_HOST_WRITE_DEVICE_READ) {
+        flags = CL_MEM_READ_ONLY;
+    } else if (pattern == ACCESS_DEVICE_WRITE_HOST_READ) {
+        flags = CL_MEM_WRITE_ONLY;
+    }
+
+    if (create(size, defaults_[pattern], flags, buffer)) {
+        return (true);
+    }
+
+    if (defaults_[pattern].alloc_type != BUFFER_ALLOC_ION_HOST_PTR) {
+        return (false);
+    }
+
+    /* ion ran out or was rejected, the portable strategy still avoids copies */
+    BufferConfig fallback = defaults_[pattern];
+    fallback.alloc_type = portable_strategy_;
+
+    CL_WARN(std::string("ion buffer failed, falling back to ") +
+            BufferAllocTypeToString(portable_strategy_) + " ");
+
+    return (create(size, fallback, flags, buffer));
+}
+
+bool BufferFactory::create(size_t              size,
+                           const BufferConfig& config,
+                           cl_mem_flags        flags,
+                           ZeroCopyBuffer    & buffer)
+{
+    cl_int error_number = 0;
+    ZeroCopyBuffer result;
+
+    if (!is_supported(config)) {
+        CL_WARN("buffer config not supported by the device ");
+        return (false);
+    }
+
+    result.config_ = config;
+    result.size_   = size;
+
+    if (config.alloc_type == BUFFER_ALLOC_HOST_PTR) {
+        result.buffer_ = cl::Buffer(context_, flags | CL_MEM_ALLOC_HOST_PTR, size,
+                                    NULL, &error_number);
+
+        if (error_number < 0) {
+            CL_WARN("Failed to create alloc host ptr buffer: " + ErrorNumberToString(error_number) + " ");
+            return (false);
+        }
+    } else if ((config.alloc_type == BUFFER_ALLOC_USE_HOST_PTR) ||
+               (config.alloc_type == BUFFER_ALLOC_SVM)) {
+        HostMemory *memory = new HostMemory();
+        /* some drivers also want the size in whole cache lines */
+        size_t padded = align_up(size, 64);
+
+#ifdef CL_VERSION_2_0
+        if (config.alloc_type == BUFFER_ALLOC_SVM) {
+            memory->ptr = clSVMAlloc(context_(), CL_MEM_READ_WRITE | CL_MEM_SVM_FINE_GRAIN_BUFFER,
+                                     padded, 0);
+            if (memory->ptr != NULL) {
+                memory->svm_context = context_();
+                clRetainContext(memory->svm_context);
+            }
+        } else
+#endif
+        if ((huge_page_threshold_ > 0) && (size >= huge_page_threshold_)) {
+            /* 2 MB aligned, which covers host_ptr_align_ */
+            memory->ptr = host_memory_alloc(padded, true, &memory->mmap_len);
+        } else if (posix_memalign(&memory->ptr, host_ptr_align_, padded) != 0) {
+            memory->ptr = NULL;
+        }
+
+        if (memory->ptr == NULL) {
+            CL_WARN("Failed to allocate host memory ");
+            delete memory;
+            return (false);
+        }
+
+        result.buffer_ = cl::Buffer(context_, flags | CL_MEM_USE_HOST_PTR, padded,
+                                    memory->ptr, &error_number);
+
+        if (error_number < 0) {
+            CL_WARN("Failed to create use host ptr buffer: " + ErrorNumberToString(error_number) + " ");
+            free_host_memory(NULL, memory);
+            return (false);
+        }
+
+        /* pending commands may still use the memory after the buffer is dropped */
+        if (result.buffer_.setDestructorCallback(free_host_memory, memory) < 0) {
+            CL_WARN("Failed to set host memory destructor callback ");
+            result.buffer_ = cl::Buffer();
+            free_host_memory(NULL, memory);
+            return (false);
+        }
+
+        if (config.alloc_type == BUFFER_ALLOC_SVM) {
+            result.mapped_ptr_ = memory->ptr;
+        }
+    } else {
+        unsigned int ion_flags = IonAllocFlagsForPolicy(config.host_cache_policy);
+
+        if ((huge_page_threshold_ > 0) && (size >= huge_page_threshold_)) {
+            ion_flags |= ION_ALLOC_HUGEPAGE;
+        }
+
+        if (IonAllocator::instance().allocate(size, result.ion_, ion_flags) < 0) {
+            CL_WARN("Failed to allocate ion memory ");
+            return (false);
+        }
+
+        if (!CreateIonBuffer(context_, flags, result.ion_, config.host_cache_policy,
+                             result.buffer_, size)) {
+            return (false);
+        }
+    }
+
+    buffer = std::move(result);
+
+    return (true);
+}
+
+const char *HostCachePolicyToString(cl_uint policy)
+{
+    switch (policy) {
+    case CL_MEM_HOST_UNCACHED_QCOM:
+        return ("uncached");
+
+    case CL_MEM_HOST_WRITEBACK_QCOM:
+        return ("write-back");
+
+    case CL_MEM_HOST_WRITETHROUGH_QCOM:
+        return ("write-through");
+
+    case CL_MEM_HOST_WRITE_COMBINING_QCOM:
+        return ("write-combine");
+
+    case CL_MEM_HOST_IOCOHERENT_QCOM:
+        return ("io-coherent");
+
+    default:
+        return ("unknown");
+    }
+}
+
+const char *BufferAllocTypeToString(BufferAllocType type)
+{
+    switch (type) {
+    case BUFFER_ALLOC_ION_HOST_PTR:
+        return ("ion");
+
+    case BUFFER_ALLOC_HOST_PTR:
+        return ("alloc_host_ptr");
+
+    case BUFFER_ALLOC_USE_HOST_PTR:
+        return ("use_host_ptr");
+
+    case BUFFER_ALLOC_SVM:
+        return ("svm");
+
+    default:
+        return ("unknown");
+    }
+}
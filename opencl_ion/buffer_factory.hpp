@@ -0,0 +1,182 @@
+#ifndef __BUFFER_FACTORY_HPP__
+#define __BUFFER_FACTORY_HPP__
+
+#include "ion_cl.hpp"
+#include "host_memory.hpp"
+
+enum BufferAccessPattern {
+    ACCESS_HOST_WRITE_DEVICE_READ = 0, // e.g. input frames
+    ACCESS_DEVICE_WRITE_HOST_READ,     // e.g. results verified on the cpu
+    ACCESS_PING_PONG,                  // host and device take turns
+    ACCESS_PATTERN_COUNT,
+};
+
+enum BufferAllocType {
+    BUFFER_ALLOC_ION_HOST_PTR = 0,    // ion memory, CL_MEM_EXT_HOST_PTR_QCOM
+    BUFFER_ALLOC_HOST_PTR,            // driver memory, CL_MEM_ALLOC_HOST_PTR
+    BUFFER_ALLOC_USE_HOST_PTR,        // aligned host memory, CL_MEM_USE_HOST_PTR
+    BUFFER_ALLOC_SVM,                 // fine-grain svm, no map needed (opencl 2.0)
+};
+
+struct BufferConfig {
+    BufferAllocType alloc_type;
+    cl_uint         host_cache_policy; // CL_MEM_HOST_*_QCOM, ion only
+};
+
+/**
+ * zero-copy buffer made by BufferFactory.
+ *
+ * host access goes through begin_host_access()/end_host_access(): mapped
+ * directly for ion memory (with cache maintenance for write-back), through
+ * enqueueMapBuffer otherwise. the device must be done with the buffer
+ * (e.g. command_queue.finish()) before host access begins.
+ */
+class ZeroCopyBuffer {
+public:
+    ZeroCopyBuffer() : size_(0), map_flags_(0), mapped_ptr_(NULL) {}
+    ~ZeroCopyBuffer();
+
+    ZeroCopyBuffer(ZeroCopyBuffer&& other) noexcept;
+    ZeroCopyBuffer& operator=(ZeroCopyBuffer&& other) noexcept;
+
+    /**
+     * @param  command_queue [queue used for map]
+     * @param  flags         [CL_MAP_READ and/or CL_MAP_WRITE]
+     * @return               [host pointer, NULL if failed]
+     */
+    void *begin_host_access(cl::CommandQueue& command_queue, cl_map_flags flags);
+
+    /**
+     * @param  command_queue [queue used for unmap]
+     * @param  host_ptr      [pointer from begin_host_access()]
+     * @return               [true for success]
+     */
+    bool end_host_access(cl::CommandQueue& command_queue, void *host_ptr);
+
+    cl::Buffer& buffer() { return buffer_; }
+
+    const BufferConfig& config() const { return config_; }
+
+    size_t size() const { return size_; }
+
+private:
+    friend class BufferFactory;
+
+    ZeroCopyBuffer(const ZeroCopyBuffer&) = delete;
+    ZeroCopyBuffer& operator=(const ZeroCopyBuffer&) = delete;
+
+    void release();
+
+    IonBuffer ion_;
+    cl::Buffer buffer_;
+    BufferConfig config_;
+    size_t size_;
+    cl_map_flags map_flags_;
+    void *mapped_ptr_;             // svm pointer or open map, unmapped on release
+    cl::CommandQueue map_queue_;   // queue of the open map
+};
+
+/**
+ * picks allocation type and host cache policy from the intended access
+ * pattern. the defaults are provisional: they follow how each policy is
+ * expected to behave, not a bench/buffer_policy_bench sweep, which has not
+ * been run yet. the only measurement so far is the device-write host-read
+ * loop of main.cpp on uncached ion (333 ms). products override the defaults
+ * with set_default_config() once they have their own numbers.
+ *
+ * without cl_qcom_ion_host_ptr every pattern uses the best zero-copy
+ * strategy of the device, chosen once by init(): fine-grain svm, then
+ * CL_MEM_USE_HOST_PTR on unified memory, then CL_MEM_ALLOC_HOST_PTR
+ * mapped around every host access, the map and unmap being the sync points.
+ */
+class BufferFactory {
+public:
+    BufferFactory();
+
+    /**
+     * query the device extensions once
+     * @param  context [opencl context]
+     * @param  device  [device the buffers are used on]
+     * @return         [true for success]
+     */
+    bool init(cl::Context context, cl::Device device);
+
+    /**
+     * @param  pattern [access pattern]
+     * @return         [config create() uses for the pattern]
+     */
+    BufferConfig default_config(BufferAccessPattern pattern) const;
+
+    /**
+     * @param  pattern [access pattern]
+     * @param  config  [config to use for the pattern from now on]
+     */
+    void set_default_config(BufferAccessPattern pattern, const BufferConfig& config);
+
+    /**
+     * @param  config [config to check]
+     * @return        [true if the device can create it]
+     */
+    bool is_supported(const BufferConfig& config) const;
+
+    /**
+     * back buffers of at least min_size bytes with 2 MB host pages (ion and
+     * CL_MEM_USE_HOST_PTR only), to cut host tlb misses on large buffers
+     * @param  min_size [bytes, 0 disables huge pages]
+     */
+    void set_huge_page_threshold(size_t min_size) { huge_page_threshold_ = min_size; }
+
+    /**
+     * @return [fastest zero-copy allocation type of the device]
+     */
+    BufferAllocType zero_copy_strategy() const { return strategy_; }
+
+    /**
+     * an ion default that cannot be allocated (e.g. the heaps are
+     * exhausted) falls back to the best strategy without ion
+     * @param  size    [bytes]
+     * @param  pattern [access pattern]
+     * @param  buffer  [return buffer]
+     * @return         [true for success]
+     */
+    bool create(size_t size, BufferAccessPattern pattern, ZeroCopyBuffer& buffer);
+
+    /**
+     * no fallback, the buffer has exactly this config or is not made
+     * @param  size   [bytes]
+     * @param  config [explicit config]
+     * @param  flags  [memory flags, e.g. CL_MEM_READ_WRITE]
+     * @param  buffer [return buffer]
+     * @return        [true for success]
+     */
+    bool create(size_t              size,
+                const BufferConfig& config,
+                cl_mem_flags        flags,
+                ZeroCopyBuffer    & buffer);
+
+private:
+    cl::Context context_;
+    bool ion_supported_;
+    bool iocoherent_supported_;
+    bool svm_supported_;
+    bool unified_memory_;
+    size_t host_ptr_align_; // CL_MEM_USE_HOST_PTR address and size alignment
+    size_t huge_page_threshold_;
+    BufferAllocType strategy_;
+    BufferAllocType portable_strategy_; // best strategy without ion
+    BufferConfig defaults_[ACCESS_PATTERN_COUNT];
+};
+
+/**
+ * @param  policy [CL_MEM_HOST_*_QCOM]
+ * @return        [short name, e.g. "write-back"]
+ */
+const char *HostCachePolicyToString(cl_uint policy);
+
+/**
+ * @param  type [allocation type]
+ * @return      [short name, e.g. "use_host_ptr"]
+ */
+const char *BufferAllocTypeToString(BufferAllocType type);
+
+#endif // ifndef __BUFFER_FACTORY_HPP__
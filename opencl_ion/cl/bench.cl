@@ -0,0 +1,5 @@
+__kernel void increment(__global int *pts){
+    const int x = get_global_id(0);
+
+    pts[x] = pts[x] + 1;
+}
@@ -0,0 +1,43 @@
+/*
+ * 3x3 box filter over an interleaved 8-bit image. built without options
+ * the geometry comes from the arguments; built with -D WIDTH, HEIGHT,
+ * STRIDE and CHANNELS (see cl_program_variants.hpp) the arguments are
+ * ignored and the compiler sees constants.
+ */
+#ifdef WIDTH
+#define IMG_WIDTH    WIDTH
+#define IMG_HEIGHT   HEIGHT
+#define IMG_STRIDE   STRIDE
+#define IMG_CHANNELS CHANNELS
+#else
+#define IMG_WIDTH    width
+#define IMG_HEIGHT   height
+#define IMG_STRIDE   stride
+#define IMG_CHANNELS channels
+#endif
+
+__kernel void box3x3(__global const uchar *src, __global uchar *dst,
+                     const int width, const int height,
+                     const int stride, const int channels){
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+
+    if ((x >= IMG_WIDTH) || (y >= IMG_HEIGHT)) {
+        return;
+    }
+
+    for (int c = 0; c < IMG_CHANNELS; c++) {
+        int sum = 0;
+
+        for (int dy = -1; dy <= 1; dy++) {
+            const int yy = clamp(y + dy, 0, IMG_HEIGHT - 1);
+
+            for (int dx = -1; dx <= 1; dx++) {
+                const int xx = clamp(x + dx, 0, IMG_WIDTH - 1);
+
+                sum += src[yy * IMG_STRIDE + xx * IMG_CHANNELS + c];
+            }
+        }
+        dst[y * IMG_STRIDE + x * IMG_CHANNELS + c] = (uchar)(sum / 9);
+    }
+}
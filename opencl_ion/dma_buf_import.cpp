@@ -0,0 +1,240 @@
+#include "dma_buf_import.hpp"
+
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* the mapping goes once opencl is done with the buffer, pending commands included */
+static void CL_CALLBACK free_mapping(cl_mem, void *user_data)
+{
+    delete (IonBuffer *)user_data;
+}
+
+/*
+ * the inode every anon_inode fd (eventfd, pre-5.3 dma-buf) shares; dma-bufs
+ * on it cannot be told apart by fstat()
+ */
+static bool is_anon_inode(const struct stat& st)
+{
+    static std::once_flag once;
+    static dev_t          anon_dev = 0;
+    static ino_t          anon_ino = 0;
+    static bool           known    = false;
+
+    std::call_once(once, []() {
+        int         fd = eventfd(0, EFD_CLOEXEC);
+        struct stat anon;
+
+        if ((fd >= 0) && (fstat(fd, &anon) == 0)) {
+            anon_dev = anon.st_dev;
+            anon_ino = anon.st_ino;
+            known    = true;
+        }
+
+        if (fd >= 0) {
+            close(fd);
+        }
+    });
+
+    /* unknown: assume the worst and cache nothing */
+    return (!known || ((st.st_dev == anon_dev) && (st.st_ino == anon_ino)));
+}
+
+DmaBufImporter::DmaBufImporter(size_t max_entries)
+    : host_cache_policy_(CL_MEM_HOST_UNCACHED_QCOM), flags_(CL_MEM_READ_WRITE),
+      max_entries_(max_entries), use_counter_(0), hits_(0), misses_(0)
+{
+}
+
+void DmaBufImporter::init(cl::Context context, cl_uint host_cache_policy, cl_mem_flags flags)
+{
+    clear();
+
+    context_           = context;
+    host_cache_policy_ = host_cache_policy;
+    flags_             = flags;
+}
+
+bool DmaBufImporter::key_of(int fd, Key& key, bool& unique)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) < 0) {
+        CL_WARN("Failed to stat imported fd ");
+        return (false);
+    }
+
+    key    = Key(st.st_dev, st.st_ino);
+    unique = !is_anon_inode(st);
+
+    return (true);
+}
+
+/*
+ * called with mutex_ held; a buffer without an inode of its own is not
+ * cached, its entry is returned in uncached
+ */
+DmaBufImporter::Entry *DmaBufImporter::lookup(int fd, size_t size, std::unique_ptr<Entry>& uncached)
+{
+    Key  key;
+    bool unique = false;
+
+    if (!key_of(fd, key, unique)) {
+        return (NULL);
+    }
+
+    std::map<Key, std::unique_ptr<Entry> >::iterator it = unique ? entries_.find(key) : entries_.end();
+
+    if ((it != entries_.end()) && (it->second->size >= size)) {
+        it->second->last_use = ++use_counter_;
+        hits_++;
+        return (it->second.get());
+    }
+    misses_++;
+
+    std::unique_ptr<Entry> entry(new Entry());
+    IonBuffer *mapping = new IonBuffer();
+
+    if ((ion_import(fd, size, *mapping) < 0) ||
+        !CreateIonBuffer(context_, flags_, *mapping, host_cache_policy_, entry->buffer, size)) {
+        delete mapping;
+        return (NULL);
+    }
+
+    if (entry->buffer.setDestructorCallback(free_mapping, mapping) != CL_SUCCESS) {
+        CL_WARN("Failed to set import destructor callback ");
+        entry->buffer = cl::Buffer();
+        delete mapping;
+        return (NULL);
+    }
+    entry->vaddr    = mapping->vaddr;
+    entry->size     = size;
+    entry->last_use = ++use_counter_;
+
+    if (!unique) {
+        uncached = std::move(entry);
+        return (uncached.get());
+    }
+
+    if (it != entries_.end()) {
+        /* same inode imported with a smaller size before; handed out
+           objects keep the old mapping alive */
+        entries_.erase(it);
+    }
+
+    while (!entries_.empty() && (entries_.size() >= max_entries_)) {
+        std::map<Key, std::unique_ptr<Entry> >::iterator oldest = entries_.begin();
+
+        for (it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->second->last_use < oldest->second->last_use) {
+                oldest = it;
+            }
+        }
+        entries_.erase(oldest);
+    }
+
+    Entry *result = entry.get();
+    entries_[key] = std::move(entry);
+
+    return (result);
+}
+
+bool DmaBufImporter::import_buffer(int fd, size_t size, cl::Buffer& buffer)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<Entry>      uncached;
+    Entry *entry = lookup(fd, size, uncached);
+
+    if (entry == NULL) {
+        return (false);
+    }
+
+    buffer = entry->buffer;
+
+    return (true);
+}
+
+bool DmaBufImporter::import_planes(int                             fd,
+                                   size_t                          size,
+                                   const std::vector<DmaBufPlane>& planes,
+                                   std::vector<cl::Image2D>      & images)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<Entry>      uncached;
+    Entry *entry = lookup(fd, size, uncached);
+
+    if (entry == NULL) {
+        return (false);
+    }
+
+    std::vector<size_t> layout;
+
+    for (size_t i = 0; i < planes.size(); i++) {
+        layout.push_back(planes[i].offset);
+        layout.push_back(planes[i].width);
+        layout.push_back(planes[i].height);
+        layout.push_back(planes[i].row_pitch);
+        layout.push_back(planes[i].format.image_channel_order);
+        layout.push_back(planes[i].format.image_channel_data_type);
+    }
+
+    std::map<std::vector<size_t>, std::vector<cl::Image2D> >::iterator cached = entry->images.find(layout);
+
+    if (cached != entry->images.end()) {
+        images = cached->second;
+        return (true);
+    }
+
+    std::vector<cl::Image2D> plane_images(planes.size());
+
+    for (size_t i = 0; i < planes.size(); i++) {
+        if (planes[i].offset + planes[i].row_pitch * planes[i].height > size) {
+            CL_WARN("image plane exceeds the imported buffer ");
+            return (false);
+        }
+
+        if (!CreateImage2DFromBuffer(context_, entry->buffer, planes[i].offset, planes[i].format,
+                                     planes[i].width, planes[i].height, planes[i].row_pitch,
+                                     flags_, plane_images[i])) {
+            return (false);
+        }
+    }
+
+    entry->images[layout] = plane_images;
+    images                = plane_images;
+
+    return (true);
+}
+
+void *DmaBufImporter::host_ptr(int fd)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Key  key;
+    bool unique = false;
+
+    if (!key_of(fd, key, unique) || !unique) {
+        return (NULL);
+    }
+
+    std::map<Key, std::unique_ptr<Entry> >::iterator it = entries_.find(key);
+
+    return ((it == entries_.end()) ? NULL : it->second->vaddr);
+}
+
+void DmaBufImporter::evict(int fd)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Key  key;
+    bool unique = false;
+
+    if (key_of(fd, key, unique) && unique) {
+        entries_.erase(key);
+    }
+}
+
+void DmaBufImporter::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    entries_.clear();
+}
@@ -0,0 +1,114 @@
+#ifndef __DMA_BUF_IMPORT_HPP__
+#define __DMA_BUF_IMPORT_HPP__
+
+#include "ion_cl.hpp"
+
+#include <sys/types.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* one image plane inside an imported buffer */
+struct DmaBufPlane {
+    size_t          offset;    // bytes from the start of the buffer
+    size_t          width;     // pixels
+    size_t          height;    // pixels
+    size_t          row_pitch; // bytes
+    cl::ImageFormat format;
+};
+
+/**
+ * zero-copy import of buffer fds made by another process (camera, decoder)
+ * as cl::Buffer or per-plane cl::Image2D.
+ *
+ * the fd is mapped and wrapped as a cl_mem_ion_host_ptr buffer the way
+ * main.cpp does it; the mapping belongs to the cl buffer and goes away with
+ * its last reference, so evicting an import never pulls memory from under
+ * cl objects callers still hold or have work queued on.
+ *
+ * imports are cached by the inode behind the fd, so a producer recycling
+ * its buffers gets the cl objects of the first import back, whatever fd
+ * number the buffer arrives with. before linux 5.3 every dma-buf shares the
+ * one anonymous inode, which says nothing about the buffer; such fds are
+ * imported again on every call. max_entries bounds the cache (least
+ * recently used goes first).
+ */
+class DmaBufImporter {
+public:
+    explicit DmaBufImporter(size_t max_entries = 16);
+
+    /**
+     * @param  context           [opencl context]
+     * @param  host_cache_policy [host cache policy of imported buffers]
+     * @param  flags             [memory flags of imported buffers]
+     */
+    void init(cl::Context  context,
+              cl_uint      host_cache_policy = CL_MEM_HOST_UNCACHED_QCOM,
+              cl_mem_flags flags = CL_MEM_READ_WRITE);
+
+    /**
+     * @param  fd     [buffer fd, stays owned by the caller]
+     * @param  size   [buffer bytes]
+     * @param  buffer [return buffer]
+     * @return        [true for success]
+     */
+    bool import_buffer(int fd, size_t size, cl::Buffer& buffer);
+
+    /**
+     * import every plane of a frame as an image
+     * @param  fd     [buffer fd, stays owned by the caller]
+     * @param  size   [buffer bytes]
+     * @param  planes [plane layouts]
+     * @param  images [return one image per plane]
+     * @return        [true for success]
+     */
+    bool import_planes(int                             fd,
+                       size_t                          size,
+                       const std::vector<DmaBufPlane>& planes,
+                       std::vector<cl::Image2D>      & images);
+
+    /**
+     * @param  fd [buffer fd]
+     * @return    [host address of the imported buffer, NULL if not in the cache]
+     */
+    void *host_ptr(int fd);
+
+    /**
+     * drop the cached import of fd, e.g. when the producer frees it
+     * @param  fd [buffer fd]
+     */
+    void evict(int fd);
+
+    void clear();
+
+    unsigned long hits() const { return hits_; }
+
+    unsigned long misses() const { return misses_; }
+
+private:
+    typedef std::pair<dev_t, ino_t> Key;
+
+    struct Entry {
+        cl::Buffer buffer; // owns the mapping, see free_mapping()
+        void *vaddr;
+        size_t size;
+        std::map<std::vector<size_t>, std::vector<cl::Image2D> > images; // by plane layout
+        unsigned long last_use;
+    };
+
+    bool key_of(int fd, Key& key, bool& unique);
+    Entry *lookup(int fd, size_t size, std::unique_ptr<Entry>& uncached);
+
+    cl::Context context_;
+    cl_uint host_cache_policy_;
+    cl_mem_flags flags_;
+    size_t max_entries_;
+    unsigned long use_counter_;
+    unsigned long hits_;
+    unsigned long misses_;
+    std::map<Key, std::unique_ptr<Entry> > entries_;
+    std::mutex mutex_;
+};
+
+#endif // ifndef __DMA_BUF_IMPORT_HPP__
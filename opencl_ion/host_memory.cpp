@@ -0,0 +1,105 @@
+#include "host_memory.hpp"
+#include "ion_wrapper.hpp"
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+static size_t align_up(size_t value, size_t align)
+{
+    return (value + align - 1) & ~(align - 1);
+}
+
+void *host_memory_alloc(size_t        len,
+                        bool          huge_pages,
+                        size_t       *alloc_len,
+                        HostPageSize *page_size)
+{
+    HostPageSize granted = HOST_PAGES_SMALL;
+    void        *ptr     = MAP_FAILED;
+
+    if (len == 0) {
+        return NULL;
+    }
+
+    if (!huge_pages) {
+        len = align_up(len, 4096);
+        ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    } else {
+        len = align_up(len, ION_HUGE_PAGE_SIZE);
+
+        /* the pages are reserved here, so a short pool fails now and not on first touch */
+        ptr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (ptr != MAP_FAILED) {
+            granted = HOST_PAGES_HUGETLB;
+        } else {
+            /* over-allocate by one huge page and trim to a 2 MB aligned range */
+            size_t padded = len + ION_HUGE_PAGE_SIZE;
+            char  *base   = (char *)mmap(NULL, padded, PROT_READ | PROT_WRITE,
+                                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if (base != MAP_FAILED) {
+                char  *aligned = (char *)align_up((uintptr_t)base, ION_HUGE_PAGE_SIZE);
+                size_t head    = aligned - base;
+                size_t tail    = padded - head - len;
+
+                if (head > 0) {
+                    munmap(base, head);
+                }
+
+                if (tail > 0) {
+                    munmap(aligned + len, tail);
+                }
+
+                ptr = aligned;
+
+                /* fails where THP is disabled, the range then keeps 4 KB pages */
+                if (madvise(ptr, len, MADV_HUGEPAGE) == 0) {
+                    granted = HOST_PAGES_TRANSPARENT_HUGE;
+                }
+            }
+        }
+
+        if (granted == HOST_PAGES_SMALL) {
+            INFO("huge pages not available, using 4 KB pages");
+        }
+    }
+
+    if (ptr == MAP_FAILED) {
+        ERR("host memory mmap failed");
+        return NULL;
+    }
+
+    *alloc_len = len;
+
+    if (page_size != NULL) {
+        *page_size = granted;
+    }
+
+    return ptr;
+}
+
+void host_memory_free(void *ptr, size_t alloc_len)
+{
+    if (ptr != NULL) {
+        munmap(ptr, alloc_len);
+    }
+}
+
+const char *host_page_size_name(HostPageSize page_size)
+{
+    switch (page_size) {
+    case HOST_PAGES_SMALL:
+        return ("4k");
+
+    case HOST_PAGES_TRANSPARENT_HUGE:
+        return ("thp");
+
+    case HOST_PAGES_HUGETLB:
+        return ("hugetlb");
+
+    default:
+        return ("unknown");
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef __HOST_MEMORY_HPP__
+#define __HOST_MEMORY_HPP__
+
+#include <stddef.h>
+
+enum HostPageSize {
+    HOST_PAGES_SMALL = 0,        // 4 KB pages
+    HOST_PAGES_TRANSPARENT_HUGE, // THP, madvise(MADV_HUGEPAGE)
+    HOST_PAGES_HUGETLB,          // reserved hugetlbfs pages, MAP_HUGETLB
+};
+
+/**
+ * anonymous host memory, e.g. for CL_MEM_USE_HOST_PTR buffers. with
+ * huge_pages the range is 2 MB aligned and backed by reserved hugetlb
+ * pages if there are enough, by transparent huge pages otherwise, and by
+ * 4 KB pages where neither is enabled.
+ * @param  len        [requested bytes]
+ * @param  huge_pages [ask for 2 MB pages]
+ * @param  alloc_len  [return bytes to pass to host_memory_free()]
+ * @param  page_size  [return page size granted, may be NULL]
+ * @return            [page aligned memory, NULL if failed]
+ */
+void *host_memory_alloc(size_t        len,
+                        bool          huge_pages,
+                        size_t       *alloc_len,
+                        HostPageSize *page_size = NULL);
+
+/**
+ * @param  ptr       [memory from host_memory_alloc()]
+ * @param  alloc_len [alloc_len from host_memory_alloc()]
+ */
+void host_memory_free(void *ptr, size_t alloc_len);
+
+/**
+ * @param  page_size [page size]
+ * @return           [short name, e.g. "thp"]
+ */
+const char *host_page_size_name(HostPageSize page_size);
+
+#endif // ifndef __HOST_MEMORY_HPP__
@@ -0,0 +1,187 @@
+#include "ion_arena.hpp"
+
+IonArena::IonArena()
+    : mode_(ION_ARENA_BUMP), alignment_(0), capacity_(0),
+      bump_offset_(0), used_bytes_(0)
+{
+}
+
+IonArena::~IonArena()
+{
+    /* the region buffer must go before the ion memory behind it */
+    buffer_ = cl::Buffer();
+}
+
+bool IonArena::init(cl::Context   context,
+                    cl::Device    device,
+                    size_t        size,
+                    IonArenaMode  mode,
+                    cl_uint       host_cache_policy,
+                    IonAllocator& allocator)
+{
+    cl_uint align_bits = 0;
+
+    if (device.getInfo(CL_DEVICE_MEM_BASE_ADDR_ALIGN, &align_bits) < 0) {
+        CL_WARN("Failed to get CL_DEVICE_MEM_BASE_ADDR_ALIGN ");
+        return (false);
+    }
+
+    /* the device reports bits */
+    alignment_ = align_bits / 8;
+
+    if (alignment_ == 0) {
+        alignment_ = 128;
+    }
+
+    /* the host mapping must match the policy the driver is told about */
+    if (allocator.allocate(size, region_, IonAllocFlagsForPolicy(host_cache_policy), "ion_arena") < 0) {
+        CL_WARN("Failed to allocate ion arena region ");
+        return (false);
+    }
+
+    if (!CreateIonBuffer(context, CL_MEM_READ_WRITE, region_, host_cache_policy, buffer_)) {
+        region_.reset();
+        return (false);
+    }
+
+    mode_     = mode;
+    capacity_ = region_.size;
+    reset();
+
+    return (true);
+}
+
+bool IonArena::reserve(size_t size, size_t *offset)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (mode_ == ION_ARENA_BUMP) {
+        if (bump_offset_ + size > capacity_) {
+            return (false);
+        }
+        *offset      = bump_offset_;
+        bump_offset_ += size;
+        used_bytes_  += size;
+        return (true);
+    }
+
+    /* first fit */
+    for (std::map<size_t, size_t>::iterator it = free_blocks_.begin(); it != free_blocks_.end(); ++it) {
+        if (it->second < size) {
+            continue;
+        }
+
+        *offset = it->first;
+
+        if (it->second > size) {
+            free_blocks_[it->first + size] = it->second - size;
+        }
+        free_blocks_.erase(it);
+        used_blocks_[*offset] = size;
+        used_bytes_          += size;
+        return (true);
+    }
+
+    return (false);
+}
+
+bool IonArena::alloc(size_t       size,
+                     cl_mem_flags flags,
+                     cl::Buffer & sub_buffer,
+                     size_t     * offset)
+{
+    cl_int error_number = 0;
+    size_t origin       = 0;
+
+    if ((size == 0) || (capacity_ == 0)) {
+        return (false);
+    }
+
+    /* keep every origin a multiple of the base address alignment */
+    size_t aligned_size = (size + alignment_ - 1) / alignment_ * alignment_;
+
+    if (!reserve(aligned_size, &origin)) {
+        CL_WARN("ion arena is full ");
+        return (false);
+    }
+
+    cl_buffer_region region;
+    region.origin = origin;
+    region.size   = size;
+
+    sub_buffer = buffer_.createSubBuffer(flags,
+                                         CL_BUFFER_CREATE_TYPE_REGION,
+                                         &region,
+                                         &error_number);
+
+    if (error_number < 0) {
+        CL_WARN("Failed to create arena sub-buffer: " + ErrorNumberToString(error_number) + " ");
+
+        if (mode_ == ION_ARENA_FREE_LIST) {
+            free(origin);
+        }
+        return (false);
+    }
+
+    if (offset) {
+        *offset = origin;
+    }
+
+    return (true);
+}
+
+void IonArena::free(size_t offset)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::map<size_t, size_t>::iterator used = used_blocks_.find(offset);
+
+    if (used == used_blocks_.end()) {
+        return;
+    }
+
+    size_t size = used->second;
+    used_blocks_.erase(used);
+    used_bytes_ -= size;
+
+    /* merge with the following and the preceding free block */
+    std::map<size_t, size_t>::iterator next = free_blocks_.lower_bound(offset);
+
+    if ((next != free_blocks_.end()) && (offset + size == next->first)) {
+        size += next->second;
+        next  = free_blocks_.erase(next);
+    }
+
+    if (next != free_blocks_.begin()) {
+        std::map<size_t, size_t>::iterator prev = next;
+        --prev;
+
+        if (prev->first + prev->second == offset) {
+            prev->second += size;
+            return;
+        }
+    }
+
+    free_blocks_[offset] = size;
+}
+
+void IonArena::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    bump_offset_ = 0;
+    used_bytes_  = 0;
+    used_blocks_.clear();
+    free_blocks_.clear();
+
+    if (capacity_ > 0) {
+        free_blocks_[0] = capacity_;
+    }
+}
+
+size_t IonArena::used() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return used_bytes_;
+}
@@ -0,0 +1,105 @@
+#ifndef __ION_ARENA_HPP__
+#define __ION_ARENA_HPP__
+
+#include "ion_cl.hpp"
+
+#include <map>
+#include <mutex>
+
+enum IonArenaMode {
+    ION_ARENA_BUMP,      // per-frame scratch, freed all at once by reset()
+    ION_ARENA_FREE_LIST, // long-lived objects, freed one by one by free()
+};
+
+/**
+ * sub-allocator over one ion buffer.
+ *
+ * the whole region is allocated and registered as a single
+ * CL_MEM_EXT_HOST_PTR_QCOM buffer once; alloc() hands out createSubBuffer
+ * views whose origin is a multiple of CL_DEVICE_MEM_BASE_ADDR_ALIGN, so
+ * small buffers cost neither an ion allocation nor a page each.
+ *
+ * sub-buffers must be dropped before their range is reused by reset() or
+ * free().
+ */
+class IonArena {
+public:
+    IonArena();
+    ~IonArena();
+
+    /**
+     * allocate and register the backing region
+     * @param  context           [opencl context]
+     * @param  device            [device the sub-buffers are used on]
+     * @param  size              [region bytes]
+     * @param  mode              [bump or free list]
+     * @param  host_cache_policy [host cache policy of the region]
+     * @param  allocator         [ion allocator of the region]
+     * @return                   [true for success]
+     */
+    bool init(cl::Context   context,
+              cl::Device    device,
+              size_t        size,
+              IonArenaMode  mode,
+              cl_uint       host_cache_policy = CL_MEM_HOST_UNCACHED_QCOM,
+              IonAllocator& allocator = IonAllocator::instance());
+
+    /**
+     * carve a sub-buffer out of the region
+     * @param  size       [bytes]
+     * @param  flags      [sub-buffer memory flags]
+     * @param  sub_buffer [return sub-buffer]
+     * @param  offset     [return offset in the region, the key for free()]
+     * @return            [true for success, false if the region is full]
+     */
+    bool alloc(size_t       size,
+               cl_mem_flags flags,
+               cl::Buffer & sub_buffer,
+               size_t     * offset = NULL);
+
+    /**
+     * give a range back, free list mode only
+     * @param  offset [offset returned by alloc()]
+     */
+    void free(size_t offset);
+
+    /**
+     * drop every allocation, e.g. at the start of a frame
+     */
+    void reset();
+
+    /**
+     * @param  offset [offset returned by alloc()]
+     * @return        [host address of the range]
+     */
+    void *host_ptr(size_t offset) const { return (char *)region_.vaddr + offset; }
+
+    cl::Buffer& buffer() { return buffer_; }
+
+    const IonBuffer& region() const { return region_; }
+
+    size_t alignment() const { return alignment_; }
+
+    size_t capacity() const { return capacity_; }
+
+    size_t used() const;
+
+private:
+    IonArena(const IonArena&) = delete;
+    IonArena& operator=(const IonArena&) = delete;
+
+    bool reserve(size_t size, size_t *offset);
+
+    IonArenaMode mode_;
+    IonBuffer region_;
+    cl::Buffer buffer_;
+    size_t alignment_;
+    size_t capacity_;
+    size_t bump_offset_;
+    std::map<size_t, size_t> free_blocks_; // offset -> size, coalesced
+    std::map<size_t, size_t> used_blocks_; // offset -> size
+    size_t used_bytes_;
+    mutable std::mutex mutex_;
+};
+
+#endif // ifndef __ION_ARENA_HPP__
@@ -0,0 +1,521 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+#include <linux/memfd.h>
+#include <linux/udmabuf.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "ion_backend.hpp"
+#include "ion_heap_chain.hpp"
+
+#if ION_HAVE_MSM_ION
+#include <linux/msm_ion.h>
+#endif
+
+#include <errno.h>
+
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB  0x0004U
+#endif
+
+#ifndef MFD_HUGE_2MB
+#define MFD_HUGE_2MB (21U << 26)
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS  (1024 + 9)
+#define F_SEAL_SHRINK 0x0002
+#endif
+
+int dma_buf_sync_cache(int fd, IonCacheOp op)
+{
+    struct dma_buf_sync sync;
+    __u64 direction = 0;
+
+    if (op & ION_CACHE_CLEAN) {
+        direction |= DMA_BUF_SYNC_WRITE;
+    }
+
+    if (op & ION_CACHE_INVALIDATE) {
+        direction |= DMA_BUF_SYNC_READ;
+    }
+
+    /*
+     * the exporter invalidates on SYNC_START and cleans on SYNC_END, so a
+     * start/end pair around nothing is a plain clean and/or invalidate
+     */
+    sync.flags = DMA_BUF_SYNC_START | direction;
+
+    if (ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync) < 0) {
+        if (errno == ENOTTY) {
+            /* not a dma-buf, e.g. a plain memfd: nothing to maintain */
+            return 0;
+        }
+        ERR("DMA_BUF_IOCTL_SYNC start failed");
+        return -6;
+    }
+
+    sync.flags = DMA_BUF_SYNC_END | direction;
+
+    if (ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync) < 0) {
+        ERR("DMA_BUF_IOCTL_SYNC end failed");
+        return -6;
+    }
+
+    return 0;
+}
+
+int IonBackend::sync_cache(const IonBuffer& ionBuf, IonCacheOp op,
+                           void *, size_t, size_t)
+{
+    return dma_buf_sync_cache(ionBuf.fd, op);
+}
+
+#if ION_HAVE_MSM_ION
+class LegacyIonBackend : public IonBackend {
+public:
+    explicit LegacyIonBackend(int ion_device_fd) : ion_device_fd_(ion_device_fd) {}
+
+    ~LegacyIonBackend()
+    {
+        close(ion_device_fd_);
+    }
+
+    IonBackendType type() const { return ION_BACKEND_LEGACY_ION; }
+
+    const char *name() const { return "ion"; }
+
+    int allocate(uint64_t len, unsigned int flags, IonBuffer& ionBuf)
+    {
+        /* ion_allocation_data.len is a size_t */
+        if (len > SIZE_MAX) {
+            ERR("ION ALLOC size too large for this abi");
+            return -1;
+        }
+
+        struct ion_allocation_data alloc_data;
+
+        memset(&alloc_data, 0, sizeof(alloc_data));
+        alloc_data.len   = len;
+        alloc_data.align = 4096;
+        alloc_data.flags = (flags & ION_ALLOC_UNCACHED) ? 0 : ION_FLAG_CACHED;
+
+        ionBuf.ion_device_fd = ion_device_fd_;
+        ionBuf.size          = len;
+        ionBuf.align         = alloc_data.align;
+        ionBuf.flags         = flags & ION_ALLOC_UNCACHED;
+
+        std::vector<unsigned int> heaps = ion_heap_chain().heaps_for(len);
+        int rc = -1;
+
+        for (size_t i = 0; i < heaps.size(); i++) {
+            alloc_data.heap_mask = 1 << heaps[i];
+            INFO("ION ALLOC unsec buf: size %llu align %d flags %x heap %u",
+                 (unsigned long long)ionBuf.size,
+                 (int)alloc_data.align, alloc_data.flags, heaps[i]);
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            rc = ioctl(ion_device_fd_, ION_IOC_ALLOC, &alloc_data);
+            double latency_us = std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start).count();
+
+            bool success = !rc && alloc_data.handle;
+            ion_heap_chain().record(heaps[i], success, latency_us, len);
+
+            if (success) {
+                break;
+            }
+            alloc_data.handle = 0;
+        }
+
+        if (rc || !alloc_data.handle) {
+            ERR("ION ALLOC memory failed 0x%x on all %d heaps", rc, (int)heaps.size());
+            return -3;
+        }
+
+        /* a pointer on older kernels, an int on newer ones */
+        ionBuf.handle    = (uintptr_t)alloc_data.handle;
+        ionBuf.heap_mask = alloc_data.heap_mask;
+
+        if (share(ionBuf)) {
+            release(ionBuf);
+            return -4;
+        }
+
+        return 0;
+    }
+
+    int share(IonBuffer& ionBuf)
+    {
+        struct ion_fd_data fd_data;
+
+        fd_data.handle = (decltype(fd_data.handle))ionBuf.handle;
+        fd_data.fd     = -1;
+
+        if (ioctl(ion_device_fd_, ION_IOC_SHARE, &fd_data)) {
+            ERR("ION SHARE failed");
+            return -4;
+        }
+        ionBuf.fd = fd_data.fd;
+
+        return 0;
+    }
+
+    int release(IonBuffer& ionBuf)
+    {
+        int rc = 0;
+
+        if (ionBuf.handle) {
+            struct ion_handle_data data;
+            data.handle   = (decltype(data.handle))ionBuf.handle;
+            rc            = ioctl(ion_device_fd_, ION_IOC_FREE, &data);
+            ionBuf.handle = 0;
+        }
+
+        return rc;
+    }
+
+    int sync_cache(const IonBuffer& ionBuf, IonCacheOp op,
+                   void *vaddr, size_t offset, size_t length)
+    {
+        if (!ionBuf.handle || (vaddr == NULL)) {
+            return dma_buf_sync_cache(ionBuf.fd, op);
+        }
+
+        struct ion_flush_data flush;
+        flush.handle = (decltype(flush.handle))ionBuf.handle;
+        flush.fd     = ionBuf.fd;
+        flush.vaddr  = vaddr;
+        flush.offset = offset;
+        flush.length = length;
+
+        unsigned long request = ION_IOC_CLEAN_INV_CACHES;
+
+        if (op == ION_CACHE_CLEAN) {
+            request = ION_IOC_CLEAN_CACHES;
+        } else if (op == ION_CACHE_INVALIDATE) {
+            request = ION_IOC_INV_CACHES;
+        }
+
+        if (ioctl(ion_device_fd_, request, &flush) < 0) {
+            ERR("ION cache op %d failed", (int)op);
+            return -6;
+        }
+
+        return 0;
+    }
+
+private:
+    int ion_device_fd_;
+};
+#endif // if ION_HAVE_MSM_ION
+
+class DmaHeapBackend : public IonBackend {
+public:
+    /* uncached_heap_fd may be -1, uncached requests then get cached memory */
+    DmaHeapBackend(int heap_fd, int uncached_heap_fd, const std::string& heap_name)
+        : heap_fd_(heap_fd), uncached_heap_fd_(uncached_heap_fd), heap_name_(heap_name) {}
+
+    ~DmaHeapBackend()
+    {
+        close(heap_fd_);
+
+        if (uncached_heap_fd_ >= 0) {
+            close(uncached_heap_fd_);
+        }
+    }
+
+    IonBackendType type() const { return ION_BACKEND_DMA_HEAP; }
+
+    const char *name() const { return "dma_heap"; }
+
+    int allocate(uint64_t len, unsigned int flags, IonBuffer& ionBuf)
+    {
+        struct dma_heap_allocation_data data;
+        bool uncached = (flags & ION_ALLOC_UNCACHED) && (uncached_heap_fd_ >= 0);
+        int heap_fd   = uncached ? uncached_heap_fd_ : heap_fd_;
+
+        memset(&data, 0, sizeof(data));
+        data.len      = len;
+        data.fd_flags = O_RDWR | O_CLOEXEC;
+
+        ionBuf.ion_device_fd = heap_fd;
+        ionBuf.size          = len;
+        ionBuf.align         = 4096;
+        ionBuf.flags         = uncached ? ION_ALLOC_UNCACHED : 0;
+        INFO("DMA HEAP ALLOC %s%s: size %llu", heap_name_.c_str(),
+             uncached ? "-uncached" : "", (unsigned long long)len);
+
+        if (ioctl(heap_fd, DMA_HEAP_IOCTL_ALLOC, &data) < 0) {
+            ERR("DMA HEAP ALLOC memory failed on %s", heap_name_.c_str());
+            return -3;
+        }
+        ionBuf.fd = data.fd;
+
+        return 0;
+    }
+
+    int share(IonBuffer& ionBuf)
+    {
+        /* a dma-buf heap hands out the shared fd directly */
+        return ionBuf.fd >= 0 ? 0 : -4;
+    }
+
+    int release(IonBuffer&)
+    {
+        return 0;
+    }
+
+private:
+    int heap_fd_;
+    int uncached_heap_fd_;
+    std::string heap_name_;
+};
+
+/*
+ * memfd on reserved 2 MB hugetlb pages, -1 if the pool is short: the pages
+ * are allocated up front so a short pool fails here and not with SIGBUS on
+ * first touch
+ */
+static int create_hugetlb_memfd(uint64_t len, unsigned int memfd_flags)
+{
+    int memfd = syscall(SYS_memfd_create, "ion-stand-in-huge",
+                        memfd_flags | MFD_HUGETLB | MFD_HUGE_2MB);
+
+    if (memfd < 0) {
+        return -1;
+    }
+
+    if ((ftruncate(memfd, len) < 0) || (fallocate(memfd, 0, 0, len) < 0)) {
+        INFO("hugetlb pages not available, using transparent huge pages");
+        close(memfd);
+        return -1;
+    }
+
+    return memfd;
+}
+
+class MemfdBackend : public IonBackend {
+public:
+    /* udmabuf_fd may be -1, buffers are then plain memfds */
+    explicit MemfdBackend(int udmabuf_fd) : udmabuf_fd_(udmabuf_fd) {}
+
+    ~MemfdBackend()
+    {
+        if (udmabuf_fd_ >= 0) {
+            close(udmabuf_fd_);
+        }
+    }
+
+    IonBackendType type() const { return ION_BACKEND_MEMFD; }
+
+    const char *name() const { return udmabuf_fd_ >= 0 ? "udmabuf" : "memfd"; }
+
+    int allocate(uint64_t len, unsigned int flags, IonBuffer& ionBuf)
+    {
+        unsigned int memfd_flags = MFD_CLOEXEC | (udmabuf_fd_ >= 0 ? MFD_ALLOW_SEALING : 0);
+        int          memfd       = -1;
+
+        if (flags & ION_ALLOC_HUGEPAGE) {
+            len   = (len + ION_HUGE_PAGE_SIZE - 1) & ~(uint64_t)(ION_HUGE_PAGE_SIZE - 1);
+            memfd = create_hugetlb_memfd(len, memfd_flags);
+        }
+
+        /* memfd pages are always cached, uncached requests are ignored */
+        ionBuf.ion_device_fd = udmabuf_fd_;
+        ionBuf.size          = len;
+        ionBuf.align         = (memfd >= 0) ? ION_HUGE_PAGE_SIZE : 4096;
+        ionBuf.flags         = 0;
+
+        if (memfd < 0) {
+            memfd = syscall(SYS_memfd_create, "ion-stand-in", memfd_flags);
+
+            if ((memfd >= 0) && (ftruncate(memfd, len) < 0)) {
+                close(memfd);
+                memfd = -1;
+            }
+        }
+
+        if (memfd < 0) {
+            ERR("ION ALLOC stand-in memfd failed");
+            return -3;
+        }
+
+        ionBuf.fd = memfd;
+
+        if (udmabuf_fd_ < 0) {
+            return 0;
+        }
+
+        /* udmabuf needs the pages pinned, i.e. a memfd that cannot shrink */
+        struct udmabuf_create create;
+        memset(&create, 0, sizeof(create));
+        create.memfd  = memfd;
+        create.flags  = UDMABUF_FLAGS_CLOEXEC;
+        create.offset = 0;
+        create.size   = len;
+
+        int dmabuf_fd = -1;
+
+        if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) == 0) {
+            dmabuf_fd = ioctl(udmabuf_fd_, UDMABUF_CREATE, &create);
+        }
+
+        if (dmabuf_fd < 0) {
+            /* keep the plain memfd, it still maps the same way */
+            ERR("UDMABUF_CREATE failed, using plain memfd");
+            return 0;
+        }
+
+        close(memfd);
+        ionBuf.fd = dmabuf_fd;
+
+        return 0;
+    }
+
+    int share(IonBuffer& ionBuf)
+    {
+        return ionBuf.fd >= 0 ? 0 : -4;
+    }
+
+    int release(IonBuffer&)
+    {
+        return 0;
+    }
+
+private:
+    int udmabuf_fd_;
+};
+
+static IonBackend *create_legacy_ion_backend()
+{
+#if !ION_HAVE_MSM_ION
+    return NULL;
+#else
+    int ion_device_fd = open(ION_DEVICE_PATH, O_RDONLY | O_CLOEXEC);
+
+    if (ion_device_fd < 0) {
+        return NULL;
+    }
+
+    return new LegacyIonBackend(ion_device_fd);
+#endif
+}
+
+static IonBackend *create_dma_heap_backend()
+{
+    /* vendor heap first, it is the one the gpu driver is tuned for */
+    static const char *heap_names[] = { "qcom,system", "system" };
+
+    for (size_t i = 0; i < sizeof(heap_names) / sizeof(heap_names[0]); i++) {
+        std::string path = std::string(DMA_HEAP_DIR) + heap_names[i];
+        int heap_fd      = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (heap_fd >= 0) {
+            std::string uncached_path = path + "-uncached";
+            int uncached_heap_fd      = open(uncached_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+            return new DmaHeapBackend(heap_fd, uncached_heap_fd, heap_names[i]);
+        }
+    }
+
+    return NULL;
+}
+
+static IonBackend *create_memfd_backend()
+{
+    return new MemfdBackend(open(UDMABUF_DEVICE, O_RDWR | O_CLOEXEC));
+}
+
+IonBackend *ion_create_backend(IonBackendType type)
+{
+    IonBackend *backend = NULL;
+
+    switch (type) {
+    case ION_BACKEND_LEGACY_ION:
+        backend = create_legacy_ion_backend();
+        break;
+
+    case ION_BACKEND_DMA_HEAP:
+        backend = create_dma_heap_backend();
+        break;
+
+    case ION_BACKEND_MEMFD:
+        backend = create_memfd_backend();
+        break;
+
+    case ION_BACKEND_AUTO:
+    default:
+        backend = create_legacy_ion_backend();
+
+        if (backend == NULL) {
+            backend = create_dma_heap_backend();
+        }
+
+        if (backend == NULL) {
+            backend = create_memfd_backend();
+        }
+        break;
+    }
+
+    if (backend) {
+        INFO("ion backend: %s", backend->name());
+    }
+
+    return backend;
+}
+
+IonBackend *ion_open_backend(const char *device_path)
+{
+    int device_fd = open(device_path, O_RDONLY | O_CLOEXEC);
+
+    if (device_fd < 0) {
+        ERR("ERROR: ION Device open() Failed %s", device_path);
+        return NULL;
+    }
+
+    struct stat st;
+
+    if ((fstat(device_fd, &st) == 0) && S_ISCHR(st.st_mode)) {
+#if ION_HAVE_MSM_ION
+        return new LegacyIonBackend(device_fd);
+#else
+        ERR("ERROR: %s is an ion device, built without ION_HAVE_MSM_ION", device_path);
+        close(device_fd);
+        return NULL;
+#endif
+    }
+
+    /* anything that is not a character device is treated as a memfd stand-in */
+    close(device_fd);
+
+    return new MemfdBackend(-1);
+}
+
+IonBackendType ion_backend_type_from_name(const char *name)
+{
+    if (name == NULL) {
+        return ION_BACKEND_AUTO;
+    }
+
+    if (strcmp(name, "ion") == 0) {
+        return ION_BACKEND_LEGACY_ION;
+    }
+
+    if (strcmp(name, "dma_heap") == 0) {
+        return ION_BACKEND_DMA_HEAP;
+    }
+
+    if (strcmp(name, "memfd") == 0) {
+        return ION_BACKEND_MEMFD;
+    }
+
+    return ION_BACKEND_AUTO;
+}
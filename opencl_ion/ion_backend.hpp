@@ -0,0 +1,117 @@
+#ifndef __ION_BACKEND_HPP__
+#define __ION_BACKEND_HPP__
+
+#include "ion_wrapper.hpp"
+
+#include <stddef.h>
+
+#define DMA_HEAP_DIR    "/dev/dma_heap/"
+#define UDMABUF_DEVICE  "/dev/udmabuf"
+
+/* the legacy ion backend needs the msm uapi header, the others build without;
+   -DION_HAVE_MSM_ION=0 leaves it out even where the header exists */
+#ifndef ION_HAVE_MSM_ION
+#if defined(__has_include)
+#if __has_include(<linux/msm_ion.h>)
+#define ION_HAVE_MSM_ION 1
+#endif
+#endif
+#endif
+
+#ifndef ION_HAVE_MSM_ION
+#define ION_HAVE_MSM_ION 0
+#endif
+
+enum IonBackendType {
+    ION_BACKEND_AUTO = 0,
+    ION_BACKEND_LEGACY_ION,   // /dev/ion, ION_IOC_ALLOC + ION_IOC_SHARE, ION_HAVE_MSM_ION only
+    ION_BACKEND_DMA_HEAP,     // /dev/dma_heap/*, DMA_HEAP_IOCTL_ALLOC
+    ION_BACKEND_MEMFD,        // memfd, wrapped by /dev/udmabuf when present
+};
+
+/**
+ * source of shareable buffer fds behind IonBuffer.
+ *
+ * a backend only produces the fd (ionBuf.fd) and fills the other IonBuffer
+ * fields; mapping and closing the fd is done by IonAllocator,
+ * so every backend hands out the same fd + vaddr pair that
+ * cl_mem_ion_host_ptr expects.
+ */
+class IonBackend {
+public:
+    virtual ~IonBackend() {}
+
+    virtual IonBackendType type() const = 0;
+
+    virtual const char *name() const = 0;
+
+    /**
+     * allocate len bytes, len is already page aligned
+     * @param  len    [bytes]
+     * @param  flags  [IonAllocFlag bits]
+     * @param  ionBuf [return buffer, fd is a shareable fd, size set]
+     * @return        [0 for success, -1 len too large, -3 alloc failed, -4 share failed]
+     */
+    virtual int allocate(uint64_t len, unsigned int flags, IonBuffer& ionBuf) = 0;
+
+    /**
+     * export the buffer as a fd into ionBuf.fd
+     * @param  ionBuf [allocated buffer]
+     * @return        [0 for success]
+     */
+    virtual int share(IonBuffer& ionBuf) = 0;
+
+    /**
+     * drop the backend handle of the buffer, the shared fd stays valid
+     * @param  ionBuf [allocated buffer]
+     * @return        [0 for success]
+     */
+    virtual int release(IonBuffer& ionBuf) = 0;
+
+    /**
+     * cpu cache maintenance, whole buffer through DMA_BUF_IOCTL_SYNC unless
+     * the backend can do ranges
+     * @param  ionBuf [buffer]
+     * @param  op     [clean, invalidate or both]
+     * @param  vaddr  [host mapping the range is relative to, the whole
+     *                 buffer or an IonWindow]
+     * @param  offset [first byte after vaddr]
+     * @param  length [bytes, never 0]
+     * @return        [0 for success, -6 sync ioctl failed]
+     */
+    virtual int sync_cache(const IonBuffer& ionBuf, IonCacheOp op,
+                           void *vaddr, size_t offset, size_t length);
+};
+
+/**
+ * whole buffer cpu cache maintenance of a dma-buf fd; plain memfds are
+ * coherent and succeed without syncing
+ * @param  fd [dma-buf fd]
+ * @param  op [clean, invalidate or both]
+ * @return    [0 for success, -6 sync ioctl failed]
+ */
+int dma_buf_sync_cache(int fd, IonCacheOp op);
+
+/**
+ * create a backend of the given type
+ * @param  type [backend type, ION_BACKEND_AUTO probes legacy ion, dma-buf
+ *               heaps and memfd in that order]
+ * @return      [new backend, NULL if the type is not available]
+ */
+IonBackend *ion_create_backend(IonBackendType type = ION_BACKEND_AUTO);
+
+/**
+ * create a backend on an explicit device; a legacy ion device for character
+ * devices, memfd otherwise (e.g. a memfd stand-in under /proc/self/fd)
+ * @param  device_path [device to open]
+ * @return             [new backend, NULL if the device cannot be opened]
+ */
+IonBackend *ion_open_backend(const char *device_path);
+
+/**
+ * @param  name [ion, dma_heap or memfd]
+ * @return      [backend type, ION_BACKEND_AUTO for unknown names]
+ */
+IonBackendType ion_backend_type_from_name(const char *name);
+
+#endif // ifndef __ION_BACKEND_HPP__
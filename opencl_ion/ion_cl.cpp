@@ -0,0 +1,163 @@
+#include "ion_cl.hpp"
+
+#include <string.h>
+#include <map>
+#include <mutex>
+
+/* cl buffers made by CreateIonBuffer(), until opencl destroys them */
+static std::map<cl_mem, int>& ion_buffers()
+{
+    static std::map<cl_mem, int> *buffers = new std::map<cl_mem, int>();
+
+    return *buffers;
+}
+
+static std::mutex& ion_buffers_mutex()
+{
+    static std::mutex *mutex = new std::mutex();
+
+    return *mutex;
+}
+
+static void CL_CALLBACK forget_ion_buffer(cl_mem memobj, void *)
+{
+    std::lock_guard<std::mutex> lock(ion_buffers_mutex());
+
+    ion_buffers().erase(memobj);
+}
+
+bool CreateIonBuffer(cl::Context      context,
+                     cl_mem_flags     flags,
+                     const IonBuffer& ionBuf,
+                     cl_uint          host_cache_policy,
+                     cl::Buffer     & buffer,
+                     size_t           size)
+{
+    cl_int error_number = 0;
+    cl_mem_ion_host_ptr cl_ion_ptr;
+
+    if (!ionBuf.is_valid() || (ionBuf.vaddr == NULL)) {
+        CL_WARN("ion buffer is not mapped ");
+        return (false);
+    }
+
+    if ((size == 0) || (size > ionBuf.size)) {
+        size = ionBuf.size;
+    }
+
+    cl_ion_ptr.ext_host_ptr.allocation_type   = CL_MEM_ION_HOST_PTR_QCOM;
+    cl_ion_ptr.ext_host_ptr.host_cache_policy = host_cache_policy;
+    cl_ion_ptr.ion_filedesc                   = ionBuf.fd;
+    cl_ion_ptr.ion_hostptr                    = ionBuf.vaddr;
+
+    buffer = cl::Buffer(context,
+                        flags | CL_MEM_USE_HOST_PTR | CL_MEM_EXT_HOST_PTR_QCOM,
+                        size,
+                        &cl_ion_ptr,
+                        &error_number);
+
+    if (error_number < 0) {
+        CL_WARN("Failed to create ion host ptr buffer: " + ErrorNumberToString(error_number) + " ");
+        return (false);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(ion_buffers_mutex());
+        ion_buffers()[buffer()] = ionBuf.fd;
+    }
+    buffer.setDestructorCallback(forget_ion_buffer);
+
+    return (true);
+}
+
+unsigned int IonAllocFlagsForPolicy(cl_uint host_cache_policy)
+{
+    bool cached = (host_cache_policy == CL_MEM_HOST_WRITEBACK_QCOM) ||
+                  (host_cache_policy == CL_MEM_HOST_IOCOHERENT_QCOM);
+
+    return (cached ? 0 : ION_ALLOC_UNCACHED);
+}
+
+bool GetIonBufferFd(const cl::Buffer& buffer,
+                    int             * fd,
+                    size_t          * offset,
+                    size_t          * size)
+{
+    cl_mem parent = NULL;
+    size_t origin = 0;
+    size_t bytes  = 0;
+
+    if ((buffer.getInfo(CL_MEM_ASSOCIATED_MEMOBJECT, &parent) < 0) ||
+        (buffer.getInfo(CL_MEM_SIZE, &bytes) < 0)) {
+        return (false);
+    }
+
+    if (parent != NULL) {
+        if (buffer.getInfo(CL_MEM_OFFSET, &origin) < 0) {
+            return (false);
+        }
+    } else {
+        parent = buffer();
+    }
+
+    std::lock_guard<std::mutex> lock(ion_buffers_mutex());
+    std::map<cl_mem, int>::iterator it = ion_buffers().find(parent);
+
+    if (it == ion_buffers().end()) {
+        return (false);
+    }
+
+    *fd     = it->second;
+    *offset = origin;
+    *size   = bytes;
+
+    return (true);
+}
+
+bool CreateImage2DFromBuffer(cl::Context     context,
+                             cl::Buffer      buffer,
+                             size_t          offset,
+                             cl::ImageFormat format,
+                             size_t          width,
+                             size_t          height,
+                             size_t          row_pitch,
+                             cl_mem_flags    flags,
+                             cl::Image2D   & image)
+{
+    cl_int error_number = 0;
+    cl::Buffer plane    = buffer;
+
+    if (offset > 0) {
+        cl_buffer_region region;
+        region.origin = offset;
+        region.size   = row_pitch * height;
+
+        plane = buffer.createSubBuffer(flags, CL_BUFFER_CREATE_TYPE_REGION, &region, &error_number);
+
+        if (error_number < 0) {
+            CL_WARN("Failed to create image plane sub-buffer: " + ErrorNumberToString(error_number) + " ");
+            return (false);
+        }
+    }
+
+    cl_image_desc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.image_type      = CL_MEM_OBJECT_IMAGE2D;
+    desc.image_width     = width;
+    desc.image_height    = height;
+    desc.image_row_pitch = row_pitch;
+    desc.buffer          = plane();
+
+    cl_mem mem = clCreateImage(context(), flags, &format, &desc, NULL, &error_number);
+
+    if (error_number < 0) {
+        CL_WARN("Failed to create image from buffer: " + ErrorNumberToString(error_number) + " ");
+        return (false);
+    }
+
+    /* the wrapper takes over the reference from clCreateImage */
+    image   = cl::Image2D();
+    image() = mem;
+
+    return (true);
+}
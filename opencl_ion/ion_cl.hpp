@@ -0,0 +1,77 @@
+#ifndef __ION_CL_HPP__
+#define __ION_CL_HPP__
+
+#include "ion_wrapper.hpp"
+#include "ocl/cl_wrapper.hpp"
+
+#include <CL/cl_ext_qcom.h>
+
+/**
+ * wrap an ion buffer as a cl_qcom_ion_host_ptr buffer, without copies.
+ * the buffer is remembered until opencl releases it, see GetIonBufferFd()
+ * @param  context           [opencl context]
+ * @param  flags             [memory flags, e.g. CL_MEM_READ_WRITE;
+ *                            CL_MEM_USE_HOST_PTR | CL_MEM_EXT_HOST_PTR_QCOM
+ *                            are added]
+ * @param  ionBuf            [mapped ion buffer, must outlive the cl buffer]
+ * @param  host_cache_policy [CL_MEM_HOST_UNCACHED_QCOM, ..._WRITEBACK_QCOM...]
+ * @param  buffer            [return buffer]
+ * @param  size              [bytes to expose, 0 for the whole ion buffer]
+ * @return                   [true for success]
+ */
+bool CreateIonBuffer(cl::Context       context,
+                     cl_mem_flags      flags,
+                     const IonBuffer & ionBuf,
+                     cl_uint           host_cache_policy,
+                     cl::Buffer      & buffer,
+                     size_t            size = 0);
+
+/**
+ * ion allocation flags whose host mapping matches a cl host cache policy;
+ * only write-back and io-coherent want cached memory
+ * @param  host_cache_policy [CL_MEM_HOST_*_QCOM]
+ * @return                   [0 or ION_ALLOC_UNCACHED]
+ */
+unsigned int IonAllocFlagsForPolicy(cl_uint host_cache_policy);
+
+/**
+ * find the ion memory behind a buffer made by CreateIonBuffer(), or behind
+ * a sub-buffer of one (e.g. from IonArena)
+ * @param  buffer [opencl buffer]
+ * @param  fd     [return shared fd, owned by the IonBuffer]
+ * @param  offset [return offset of buffer in the fd]
+ * @param  size   [return bytes of buffer]
+ * @return        [true if buffer is backed by ion memory]
+ */
+bool GetIonBufferFd(const cl::Buffer& buffer,
+                    int             * fd,
+                    size_t          * offset,
+                    size_t          * size);
+
+/**
+ * 2d image view of a buffer range through cl_khr_image2d_from_buffer, no
+ * copies. a non-zero offset goes through a sub-buffer, so it must be a
+ * multiple of CL_DEVICE_MEM_BASE_ADDR_ALIGN; row_pitch must be a multiple of
+ * CL_DEVICE_IMAGE_PITCH_ALIGNMENT pixels.
+ * @param  context   [opencl context]
+ * @param  buffer    [backing buffer]
+ * @param  offset    [first byte of the image in buffer]
+ * @param  format    [image format, e.g. CL_R / CL_UNORM_INT8]
+ * @param  width     [pixels]
+ * @param  height    [pixels]
+ * @param  row_pitch [bytes]
+ * @param  flags     [memory flags, e.g. CL_MEM_READ_ONLY]
+ * @param  image     [return image]
+ * @return           [true for success]
+ */
+bool CreateImage2DFromBuffer(cl::Context     context,
+                             cl::Buffer      buffer,
+                             size_t          offset,
+                             cl::ImageFormat format,
+                             size_t          width,
+                             size_t          height,
+                             size_t          row_pitch,
+                             cl_mem_flags    flags,
+                             cl::Image2D   & image);
+
+#endif // ifndef __ION_CL_HPP__
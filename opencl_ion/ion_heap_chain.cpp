@@ -0,0 +1,153 @@
+#include "ion_heap_chain.hpp"
+#include "ion_backend.hpp"
+
+#if ION_HAVE_MSM_ION
+#include <linux/msm_ion.h>
+#endif
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+/* a heap that failed is tried last for this long */
+#define FAILURE_COOLDOWN_SECONDS 1.0
+
+/* weight of the newest sample in the latency average */
+#define LATENCY_EWMA_WEIGHT 0.125
+
+/* successful allocations before a heap counts as measured */
+#define LATENCY_MIN_SAMPLES 4
+
+/* per MB latency ratio that demotes a heap behind a later one */
+#define LATENCY_DEMOTE_RATIO 2.0
+
+static double now_seconds()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+IonHeapChain::IonHeapChain()
+    : latency_ordering_(false)
+{
+#if ION_HAVE_MSM_ION
+    default_heaps_.push_back(ION_IOMMU_HEAP_ID);
+    default_heaps_.push_back(ION_SYSTEM_HEAP_ID);
+    default_heaps_.push_back(ION_SYSTEM_CONTIG_HEAP_ID);
+#ifdef ION_CARVEOUT_HEAP_ID
+    /* last resort, see ion_heap_chain.hpp */
+    default_heaps_.push_back(ION_CARVEOUT_HEAP_ID);
+#endif
+#endif
+}
+
+void IonHeapChain::set_default_heaps(const std::vector<unsigned int>& heap_ids)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    default_heaps_ = heap_ids;
+}
+
+void IonHeapChain::set_size_class_heaps(size_t max_size, const std::vector<unsigned int>& heap_ids)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    size_classes_[max_size] = heap_ids;
+}
+
+void IonHeapChain::set_latency_ordering(bool enable)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    latency_ordering_ = enable;
+}
+
+std::vector<unsigned int> IonHeapChain::heaps_for(size_t len)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<size_t, std::vector<unsigned int> >::iterator size_class = size_classes_.lower_bound(len);
+    std::vector<unsigned int> heaps = (size_class == size_classes_.end()) ? default_heaps_
+                                                                          : size_class->second;
+
+    if (!latency_ordering_) {
+        return heaps;
+    }
+
+    /* heaps that failed recently go last, in configured order */
+    double now = now_seconds();
+    std::vector<unsigned int> ordered, failed;
+
+    for (size_t i = 0; i < heaps.size(); i++) {
+        HeapState& state = heaps_[heaps[i]];
+
+        if ((state.stats.failures > 0) && (now - state.last_failure < FAILURE_COOLDOWN_SECONDS)) {
+            failed.push_back(heaps[i]);
+            continue;
+        }
+
+        /* a heap only overtakes measured, clearly slower heaps before it */
+        size_t position = ordered.size();
+
+        while ((position > 0) && slower(heaps_[ordered[position - 1]], state)) {
+            position--;
+        }
+        ordered.insert(ordered.begin() + position, heaps[i]);
+    }
+
+    ordered.insert(ordered.end(), failed.begin(), failed.end());
+
+    return ordered;
+}
+
+bool IonHeapChain::slower(const HeapState& a, const HeapState& b)
+{
+    if ((a.stats.attempts - a.stats.failures < LATENCY_MIN_SAMPLES) ||
+        (b.stats.attempts - b.stats.failures < LATENCY_MIN_SAMPLES)) {
+        return false;
+    }
+
+    return a.stats.avg_us_per_mb > LATENCY_DEMOTE_RATIO * b.stats.avg_us_per_mb;
+}
+
+void IonHeapChain::record(unsigned int heap_id, bool success, double latency_us, size_t len)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    HeapState& state = heaps_[heap_id];
+
+    state.stats.attempts++;
+
+    if (!success) {
+        state.stats.failures++;
+        state.last_failure = now_seconds();
+        return;
+    }
+
+    /* per MB, so small and large requests compare; requests under a MB
+       count as one, their cost is mostly the fixed ioctl overhead */
+    double us_per_mb = latency_us / std::max(1.0, (double)len / (1024 * 1024));
+
+    if (state.stats.attempts - state.stats.failures == 1) {
+        state.stats.avg_us_per_mb = us_per_mb;
+    } else {
+        state.stats.avg_us_per_mb += LATENCY_EWMA_WEIGHT * (us_per_mb - state.stats.avg_us_per_mb);
+    }
+}
+
+std::map<unsigned int, IonHeapStats> IonHeapChain::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<unsigned int, IonHeapStats> result;
+
+    for (std::map<unsigned int, HeapState>::iterator it = heaps_.begin(); it != heaps_.end(); ++it) {
+        result[it->first] = it->second.stats;
+    }
+
+    return result;
+}
+
+IonHeapChain& ion_heap_chain()
+{
+    static IonHeapChain chain;
+
+    return chain;
+}
@@ -0,0 +1,98 @@
+#ifndef __ION_HEAP_CHAIN_HPP__
+#define __ION_HEAP_CHAIN_HPP__
+
+#include <stddef.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+struct IonHeapStats {
+    unsigned long attempts;
+    unsigned long failures;
+    double        avg_us_per_mb; // moving average of successful allocations, per MB requested
+};
+
+/**
+ * ordered legacy ion heaps to try for an allocation.
+ *
+ * every size class (requests up to max_size) has its own preference list,
+ * larger requests use the default list. the legacy ion backend walks the
+ * list until a heap satisfies the request and records how long each heap
+ * took per MB.
+ *
+ * the default list has no carveout heap: msm kernels define no
+ * general-purpose carveout id, their carveouts (adsp, audio, qsecom,
+ * camera, sf) are reserved for one client each, and draining one breaks
+ * that client. products whose only physically contiguous pool is such a
+ * carveout build with -DION_CARVEOUT_HEAP_ID=<id>, which puts it last in
+ * the default list, or add it with set_default_heaps().
+ *
+ * the configured order is used as is unless latency ordering is turned on.
+ * then a heap that just failed goes to the end of the list for a while, and
+ * a heap moves behind a later one only when both are measured and it is
+ * LATENCY_DEMOTE_RATIO times slower per MB; unmeasured heaps keep their
+ * place.
+ */
+class IonHeapChain {
+public:
+    /* iommu, system, system-contig, then ION_CARVEOUT_HEAP_ID if defined */
+    IonHeapChain();
+
+    /**
+     * @param  heap_ids [heap ids (e.g. ION_SYSTEM_HEAP_ID) in preference order]
+     */
+    void set_default_heaps(const std::vector<unsigned int>& heap_ids);
+
+    /**
+     * @param  max_size [largest request of the class in bytes]
+     * @param  heap_ids [heap ids in preference order]
+     */
+    void set_size_class_heaps(size_t max_size, const std::vector<unsigned int>& heap_ids);
+
+    /**
+     * @param  enable [demote failing and measurably slower heaps within the
+     *                 configured order, off by default]
+     */
+    void set_latency_ordering(bool enable);
+
+    /**
+     * @param  len [request bytes]
+     * @return     [heap ids to try, in order]
+     */
+    std::vector<unsigned int> heaps_for(size_t len);
+
+    /**
+     * @param  heap_id    [heap tried]
+     * @param  success    [true if the heap satisfied the request]
+     * @param  latency_us [time the ALLOC ioctl took]
+     * @param  len        [request bytes]
+     */
+    void record(unsigned int heap_id, bool success, double latency_us, size_t len);
+
+    /**
+     * @return [per heap id stats]
+     */
+    std::map<unsigned int, IonHeapStats> stats();
+
+private:
+    struct HeapState {
+        IonHeapStats stats;
+        double       last_failure; // seconds, steady clock
+    };
+
+    /* true if a is measured, b is measured and a is clearly slower */
+    static bool slower(const HeapState& a, const HeapState& b);
+
+    std::vector<unsigned int> default_heaps_;
+    std::map<size_t, std::vector<unsigned int> > size_classes_;
+    std::map<unsigned int, HeapState> heaps_;
+    bool latency_ordering_;
+    std::mutex mutex_;
+};
+
+/**
+ * @return [process wide chain used by the legacy ion backend]
+ */
+IonHeapChain& ion_heap_chain();
+
+#endif // ifndef __ION_HEAP_CHAIN_HPP__
@@ -0,0 +1,524 @@
+#include "ion_pool.hpp"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <new>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+/* written by its owner only, except that trim() may empty nodes[]; one line per owner */
+struct alignas(64) IonBufferPool::ThreadCache {
+    std::atomic<unsigned long> owner;                        // thread token, 0 if free
+    std::atomic<uint32_t>      nodes[ION_POOL_THREAD_CACHE]; // 0 if empty
+    std::atomic<unsigned long> hits;                         // owner only, no rmw needed
+    std::atomic<unsigned long> releases;
+    uint32_t                   spare;                        // empty node kept from the last hit
+};
+
+/* pools still alive, so an exiting thread never flushes into a destroyed one */
+static std::mutex& registry_mutex()
+{
+    static std::mutex *mutex = new std::mutex();
+
+    return *mutex;
+}
+
+static std::set<unsigned long>& live_pools()
+{
+    static std::set<unsigned long> *pools = new std::set<unsigned long>();
+
+    return *pools;
+}
+
+static std::atomic<unsigned long> next_pool_id(1);
+static std::atomic<unsigned long> next_thread_token(1);
+
+/* per-thread: the caches this thread owns, given back when it exits */
+struct IonPoolThreadState {
+    struct Entry {
+        IonBufferPool              *pool;
+        unsigned long               pool_id;
+        IonBufferPool::ThreadCache *cache;
+    };
+
+    unsigned long token;
+    Entry         entries[4];
+    size_t        count;
+
+    IonPoolThreadState() : token(next_thread_token++), count(0) {}
+
+    ~IonPoolThreadState()
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+
+        for (size_t i = 0; i < count; i++) {
+            if (live_pools().count(entries[i].pool_id)) {
+                entries[i].pool->flush_thread_cache(entries[i].cache);
+            }
+        }
+    }
+};
+
+static thread_local IonPoolThreadState thread_state;
+
+IonBufferPool::IonBufferPool(IonAllocator& allocator, size_t high_water_bytes)
+    : allocator_(allocator),
+    id_(next_pool_id++),
+    high_water_bytes_(high_water_bytes),
+    cached_bytes_(0),
+    peak_cached_bytes_(0),
+    hits_(0),
+    misses_(0),
+    releases_(0),
+    evictions_(0),
+    free_nodes_(0),
+    node_count_(0),
+    thread_caches_(NULL)
+{
+    void *caches = NULL;
+
+    /* operator new[] only guarantees 16 byte alignment before c++17 */
+    if (posix_memalign(&caches, alignof(ThreadCache), sizeof(ThreadCache) * ION_POOL_THREAD_SLOTS) != 0) {
+        throw std::bad_alloc();
+    }
+    thread_caches_ = static_cast<ThreadCache *>(caches);
+
+    for (int i = 0; i < ION_POOL_CLASSES; i++) {
+        classes_[i].class_size.store(0);
+        classes_[i].head.store(0);
+    }
+
+    for (int i = 0; i < ION_POOL_MAX_CHUNKS; i++) {
+        chunks_[i].store(NULL);
+    }
+
+    for (int i = 0; i < ION_POOL_THREAD_SLOTS; i++) {
+        new (&thread_caches_[i]) ThreadCache();
+        thread_caches_[i].owner.store(0);
+        thread_caches_[i].hits.store(0);
+        thread_caches_[i].releases.store(0);
+        thread_caches_[i].spare = 0;
+
+        for (int k = 0; k < ION_POOL_THREAD_CACHE; k++) {
+            thread_caches_[i].nodes[k].store(0);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    live_pools().insert(id_);
+}
+
+IonBufferPool::~IonBufferPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        live_pools().erase(id_);
+    }
+
+    trim(0);
+
+    for (int i = 0; i < ION_POOL_MAX_CHUNKS; i++) {
+        delete[] chunks_[i].load();
+    }
+
+    for (int i = 0; i < ION_POOL_THREAD_SLOTS; i++) {
+        thread_caches_[i].~ThreadCache();
+    }
+    free(thread_caches_);
+}
+
+IonBufferPool::Node *IonBufferPool::node(uint32_t index) const
+{
+    uint32_t i = index - 1;
+
+    return &chunks_[i / ION_POOL_CHUNK_NODES].load(std::memory_order_acquire)[i % ION_POOL_CHUNK_NODES];
+}
+
+uint32_t IonBufferPool::new_node()
+{
+    uint32_t index = pop(free_nodes_);
+
+    if (index != 0) {
+        return index;
+    }
+
+    uint32_t i     = node_count_.fetch_add(1);
+    uint32_t chunk = i / ION_POOL_CHUNK_NODES;
+
+    if (chunk >= ION_POOL_MAX_CHUNKS) {
+        node_count_.fetch_sub(1);
+        return 0;
+    }
+
+    if (chunks_[chunk].load(std::memory_order_acquire) == NULL) {
+        Node *fresh    = new Node[ION_POOL_CHUNK_NODES];
+        Node *expected = NULL;
+
+        /* another thread may have added the chunk meanwhile */
+        if (!chunks_[chunk].compare_exchange_strong(expected, fresh)) {
+            delete[] fresh;
+        }
+    }
+
+    return i + 1;
+}
+
+void IonBufferPool::push(std::atomic<uint64_t>& head, uint32_t index)
+{
+    uint64_t old_head = head.load(std::memory_order_relaxed);
+    uint64_t new_head;
+
+    do {
+        node(index)->next.store((uint32_t)old_head, std::memory_order_relaxed);
+        new_head = (((old_head >> 32) + 1) << 32) | index;
+    } while (!head.compare_exchange_weak(old_head, new_head,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed));
+}
+
+uint32_t IonBufferPool::pop(std::atomic<uint64_t>& head)
+{
+    uint64_t old_head = head.load(std::memory_order_acquire);
+    uint64_t new_head;
+
+    do {
+        uint32_t index = (uint32_t)old_head;
+
+        if (index == 0) {
+            return 0;
+        }
+
+        /* may be stale if the node was popped meanwhile, the tag then fails the exchange */
+        uint32_t next = node(index)->next.load(std::memory_order_relaxed);
+        new_head = (((old_head >> 32) + 1) << 32) | next;
+    } while (!head.compare_exchange_weak(old_head, new_head,
+                                         std::memory_order_acquire,
+                                         std::memory_order_acquire));
+
+    return (uint32_t)old_head;
+}
+
+IonBufferPool::ClassSlot *IonBufferPool::find_class(size_t class_size, bool insert)
+{
+    /* 0 marks unused slots, it is never a class */
+    if (class_size == 0) {
+        return NULL;
+    }
+
+    size_t start = (class_size / 4096) % ION_POOL_CLASSES;
+
+    for (size_t probe = 0; probe < ION_POOL_CLASSES; probe++) {
+        ClassSlot *slot = &classes_[(start + probe) % ION_POOL_CLASSES];
+        size_t     size = slot->class_size.load(std::memory_order_acquire);
+
+        if (size == class_size) {
+            return slot;
+        }
+
+        if (size == 0) {
+            if (!insert) {
+                return NULL;
+            }
+
+            /* slots are claimed once and keep their class for the pool lifetime */
+            if (slot->class_size.compare_exchange_strong(size, class_size) ||
+                (size == class_size)) {
+                return slot;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+IonBufferPool::ThreadCache *IonBufferPool::thread_cache()
+{
+    IonPoolThreadState& state = thread_state;
+
+    for (size_t i = 0; i < state.count; i++) {
+        if (state.entries[i].pool_id == id_) {
+            return state.entries[i].cache;
+        }
+    }
+
+    if (state.count == sizeof(state.entries) / sizeof(state.entries[0])) {
+        /* forget pools destroyed since, only on this thread's first use of a pool */
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        size_t live = 0;
+
+        for (size_t i = 0; i < state.count; i++) {
+            if (live_pools().count(state.entries[i].pool_id)) {
+                state.entries[live++] = state.entries[i];
+            }
+        }
+        state.count = live;
+
+        if (state.count == sizeof(state.entries) / sizeof(state.entries[0])) {
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < ION_POOL_THREAD_SLOTS; i++) {
+        unsigned long free_owner = 0;
+
+        if (thread_caches_[i].owner.compare_exchange_strong(free_owner, state.token)) {
+            IonPoolThreadState::Entry entry = { this, id_, &thread_caches_[i] };
+            state.entries[state.count++] = entry;
+            return &thread_caches_[i];
+        }
+    }
+
+    /* more threads than slots, this one shares the stacks only */
+    return NULL;
+}
+
+void IonBufferPool::take(uint32_t index, IonBuffer& ionBuf)
+{
+    Node *entry = node(index);
+
+    ionBuf = std::move(entry->buffer);
+    cached_bytes_.fetch_sub(entry->class_size.load(std::memory_order_relaxed));
+    push(free_nodes_, index);
+}
+
+size_t IonBufferPool::evict(uint32_t index)
+{
+    Node  *entry      = node(index);
+    size_t class_size = entry->class_size.load(std::memory_order_relaxed);
+
+    entry->buffer.reset();
+    cached_bytes_.fetch_sub(class_size);
+    evictions_++;
+    push(free_nodes_, index);
+
+    return class_size;
+}
+
+void IonBufferPool::park(uint32_t index)
+{
+    ClassSlot *slot = find_class(node(index)->class_size.load(std::memory_order_relaxed), true);
+
+    if (slot == NULL) {
+        /* every class slot holds another size */
+        evict(index);
+        return;
+    }
+
+    push(slot->head, index);
+}
+
+int IonBufferPool::acquire(uint64_t size, IonBuffer& ionBuf)
+{
+    if ((size == 0) || (size > SIZE_MAX - 4095)) {
+        ERR("Invalid input to IonBufferPool::acquire");
+        return -1;
+    }
+
+    size_t       class_size = size_class((size_t)size);
+    ThreadCache *cache      = thread_cache();
+
+    if (cache != NULL) {
+        for (int k = 0; k < ION_POOL_THREAD_CACHE; k++) {
+            uint32_t index = cache->nodes[k].load(std::memory_order_acquire);
+
+            /*
+             * only this thread fills the entry and trim() only empties it,
+             * so a successful exchange means the class read is current
+             */
+            if ((index != 0) &&
+                (node(index)->class_size.load(std::memory_order_relaxed) == class_size) &&
+                cache->nodes[k].compare_exchange_strong(index, 0)) {
+                /* the node stays with the thread for its next release */
+                ionBuf = std::move(node(index)->buffer);
+                cached_bytes_.fetch_sub(class_size);
+                cache->hits.store(cache->hits.load(std::memory_order_relaxed) + 1,
+                                  std::memory_order_relaxed);
+
+                if (cache->spare != 0) {
+                    push(free_nodes_, cache->spare);
+                }
+                cache->spare = index;
+                return 0;
+            }
+        }
+    }
+
+    ClassSlot *slot = find_class(class_size, false);
+
+    if (slot != NULL) {
+        uint32_t index = pop(slot->head);
+
+        if (index != 0) {
+            take(index, ionBuf);
+            hits_++;
+            return 0;
+        }
+    }
+
+    misses_++;
+
+    return allocator_.allocate(class_size, ionBuf);
+}
+
+void IonBufferPool::release(IonBuffer& ionBuf)
+{
+    /* moved-from or empty, nothing to recycle */
+    if (!ionBuf.is_valid() || (ionBuf.size == 0)) {
+        ionBuf.reset();
+        return;
+    }
+
+    size_t class_size = ionBuf.size;
+
+    /* private caches count against high water like the stacks; reserve
+       the bytes first so the count never goes over, not even briefly */
+    size_t cached = cached_bytes_.load(std::memory_order_relaxed);
+
+    do {
+        if (cached + class_size > high_water_bytes_.load(std::memory_order_relaxed)) {
+            releases_++;
+            evictions_++;
+            ionBuf.reset();
+            return;
+        }
+    } while (!cached_bytes_.compare_exchange_weak(cached, cached + class_size));
+
+    cached += class_size;
+
+    size_t peak = peak_cached_bytes_.load(std::memory_order_relaxed);
+
+    while ((cached > peak) && !peak_cached_bytes_.compare_exchange_weak(peak, cached)) {
+    }
+
+    ThreadCache *cache = thread_cache();
+
+    /* fast path, touches only lines of this thread besides the byte count */
+    if (cache != NULL) {
+        for (int k = 0; k < ION_POOL_THREAD_CACHE; k++) {
+            if (cache->nodes[k].load(std::memory_order_relaxed) != 0) {
+                continue;
+            }
+
+            uint32_t index = cache->spare;
+
+            if ((index == 0) && ((index = new_node()) == 0)) {
+                break;
+            }
+            cache->spare = 0;
+
+            Node *entry = node(index);
+            entry->buffer = std::move(ionBuf);
+            entry->class_size.store(class_size, std::memory_order_relaxed);
+            cache->releases.store(cache->releases.load(std::memory_order_relaxed) + 1,
+                                  std::memory_order_relaxed);
+
+            /* trim() only empties entries, so the one seen empty is still empty */
+            cache->nodes[k].store(index, std::memory_order_release);
+            return;
+        }
+    }
+
+    releases_++;
+
+    uint32_t index = new_node();
+
+    if (index == 0) {
+        cached_bytes_.fetch_sub(class_size);
+        evictions_++;
+        ionBuf.reset();
+        return;
+    }
+
+    Node *entry = node(index);
+    entry->buffer = std::move(ionBuf);
+    entry->class_size.store(class_size, std::memory_order_relaxed);
+
+    park(index);
+}
+
+uint32_t IonBufferPool::unpark_thread_cache(ThreadCache *cache, int k)
+{
+    uint32_t index = cache->nodes[k].exchange(0);
+
+    /* already in cached_bytes_, it only moves to the shared stacks */
+    if (index != 0) {
+        park(index);
+    }
+
+    return index;
+}
+
+void IonBufferPool::flush_thread_cache(ThreadCache *cache)
+{
+    for (int k = 0; k < ION_POOL_THREAD_CACHE; k++) {
+        unpark_thread_cache(cache, k);
+    }
+
+    if (cache->spare != 0) {
+        push(free_nodes_, cache->spare);
+        cache->spare = 0;
+    }
+
+    cache->owner.store(0);
+}
+
+size_t IonBufferPool::trim(size_t target_bytes)
+{
+    size_t freed = 0;
+
+    /* drain the private caches into the stacks, their owners refill them later */
+    for (int i = 0; i < ION_POOL_THREAD_SLOTS; i++) {
+        for (int k = 0; k < ION_POOL_THREAD_CACHE; k++) {
+            unpark_thread_cache(&thread_caches_[i], k);
+        }
+    }
+
+    std::vector<std::pair<size_t, ClassSlot *> > slots;
+
+    for (int i = 0; i < ION_POOL_CLASSES; i++) {
+        size_t class_size = classes_[i].class_size.load();
+
+        if (class_size != 0) {
+            slots.push_back(std::make_pair(class_size, &classes_[i]));
+        }
+    }
+
+    std::sort(slots.rbegin(), slots.rend());
+
+    for (size_t i = 0; i < slots.size() && cached_bytes_.load() > target_bytes; i++) {
+        uint32_t index;
+
+        while ((cached_bytes_.load() > target_bytes) && ((index = pop(slots[i].second->head)) != 0)) {
+            freed += evict(index);
+        }
+    }
+
+    return freed;
+}
+
+void IonBufferPool::set_high_water(size_t high_water_bytes)
+{
+    high_water_bytes_.store(high_water_bytes);
+    trim(high_water_bytes);
+}
+
+IonPoolStats IonBufferPool::stats() const
+{
+    IonPoolStats stats;
+
+    stats.hits              = hits_.load();
+    stats.misses            = misses_.load();
+    stats.releases          = releases_.load();
+    stats.evictions         = evictions_.load();
+    stats.cached_bytes      = cached_bytes_.load();
+    stats.peak_cached_bytes = peak_cached_bytes_.load();
+
+    for (int i = 0; i < ION_POOL_THREAD_SLOTS; i++) {
+        stats.hits     += thread_caches_[i].hits.load(std::memory_order_relaxed);
+        stats.releases += thread_caches_[i].releases.load(std::memory_order_relaxed);
+    }
+
+    return stats;
+}
@@ -0,0 +1,140 @@
+#ifndef __ION_POOL_HPP__
+#define __ION_POOL_HPP__
+
+#include "ion_wrapper.hpp"
+
+#include <stdint.h>
+#include <atomic>
+
+struct IonPoolThreadState;
+
+#define ION_POOL_CLASSES      64   // distinct size classes cached at once
+#define ION_POOL_THREAD_SLOTS 64   // threads with a private cache, others share the stacks
+#define ION_POOL_THREAD_CACHE 4    // buffers parked per thread
+#define ION_POOL_CHUNK_NODES  64
+#define ION_POOL_MAX_CHUNKS   1024 // ION_POOL_CHUNK_NODES * ION_POOL_MAX_CHUNKS buffers at most
+
+struct IonPoolStats {
+    unsigned long hits;         // acquire served from a free list
+    unsigned long misses;       // acquire that had to allocate
+    unsigned long releases;     // buffers returned to the pool
+    unsigned long evictions;    // cached buffers freed by trim or high-water
+    size_t        cached_bytes; // bytes parked in free lists and thread caches
+    size_t        peak_cached_bytes; // of cached_bytes
+};
+
+/**
+ * recycles ion buffers by page rounded size class.
+ *
+ * released buffers stay allocated and mapped in a per-class free list, so
+ * acquiring a recycled buffer costs no ioctl and no mmap. the bytes parked
+ * in free lists, private caches included, never exceed high_water_bytes;
+ * trim() gives memory back under pressure.
+ *
+ * acquire() and release() take no lock: every thread first uses a small
+ * private cache of ION_POOL_THREAD_CACHE buffers, then one lock-free stack
+ * per size class. a release is freed instead of cached once it would take
+ * the pool over high_water_bytes, whichever of the two it would go to, and
+ * trim() drains the private caches first. stack heads are
+ * a 32-bit node index plus a 32-bit tag bumped on every update, so a node
+ * popped and pushed back between a load and the compare-exchange is not
+ * mistaken for the old head (aba). nodes are never freed before the pool,
+ * so a stale next read is always safe.
+ */
+class IonBufferPool {
+public:
+    /**
+     * @param  allocator        [allocator used on a miss]
+     * @param  high_water_bytes [max bytes kept in free lists]
+     */
+    IonBufferPool(IonAllocator& allocator, size_t high_water_bytes);
+
+    /**
+     * no thread may use the pool any more when it is destroyed
+     */
+    ~IonBufferPool();
+
+    /**
+     * get a buffer of at least size bytes
+     * @param  size   [requested bytes]
+     * @param  ionBuf [return buffer]
+     * @return        [0 for success, allocator error code otherwise]
+     */
+    int acquire(uint64_t size, IonBuffer& ionBuf);
+
+    /**
+     * give a buffer from acquire() back to its size class; an empty buffer
+     * is ignored
+     * @param  ionBuf [buffer to recycle, empty afterwards]
+     */
+    void release(IonBuffer& ionBuf);
+
+    /**
+     * free cached buffers, largest classes first, until at most
+     * target_bytes stay cached; per-thread caches are drained first
+     * @param  target_bytes [bytes allowed to stay cached, 0 drops all]
+     * @return              [bytes freed]
+     */
+    size_t trim(size_t target_bytes = 0);
+
+    /**
+     * @param  high_water_bytes [new limit, trims if already above it]
+     */
+    void set_high_water(size_t high_water_bytes);
+
+    IonPoolStats stats() const;
+
+    /**
+     * @param  size [requested bytes]
+     * @return      [size class serving the request]
+     */
+    static size_t size_class(size_t size) { return (size + 4095) & ~(size_t)4095; }
+
+private:
+    friend struct IonPoolThreadState;
+
+    IonBufferPool(const IonBufferPool&) = delete;
+    IonBufferPool& operator=(const IonBufferPool&) = delete;
+
+    struct ThreadCache;
+
+    struct Node {
+        IonBuffer buffer;
+        std::atomic<size_t> class_size;
+        std::atomic<uint32_t> next; // node index, 0 ends the stack
+    };
+
+    struct ClassSlot {
+        std::atomic<size_t> class_size; // 0 while the slot is unused, never a class
+        std::atomic<uint64_t> head;     // tag << 32 | node index
+    };
+
+    Node *node(uint32_t index) const;
+    uint32_t new_node();
+    void push(std::atomic<uint64_t>& head, uint32_t index);
+    uint32_t pop(std::atomic<uint64_t>& head);
+    ClassSlot *find_class(size_t class_size, bool insert);
+    ThreadCache *thread_cache();
+    void park(uint32_t index);
+    void take(uint32_t index, IonBuffer& ionBuf);
+    size_t evict(uint32_t index);
+    uint32_t unpark_thread_cache(ThreadCache *cache, int k);
+    void flush_thread_cache(ThreadCache *cache);
+
+    IonAllocator& allocator_;
+    unsigned long id_; // never reused, unlike the address
+    std::atomic<size_t> high_water_bytes_;
+    std::atomic<size_t> cached_bytes_;
+    std::atomic<size_t> peak_cached_bytes_;
+    std::atomic<unsigned long> hits_;
+    std::atomic<unsigned long> misses_;
+    std::atomic<unsigned long> releases_;
+    std::atomic<unsigned long> evictions_;
+    ClassSlot classes_[ION_POOL_CLASSES];
+    std::atomic<uint64_t> free_nodes_;
+    std::atomic<uint32_t> node_count_;
+    std::atomic<Node *> chunks_[ION_POOL_MAX_CHUNKS];
+    ThreadCache *thread_caches_;
+};
+
+#endif // ifndef __ION_POOL_HPP__
@@ -0,0 +1,331 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "ion_stats.hpp"
+#include "ion_wrapper.hpp"
+
+struct LiveRecord {
+    uint64_t     len;
+    unsigned int heap_mask;
+    std::string  tag;
+    std::chrono::steady_clock::time_point allocated;
+};
+
+struct StatsRegistry {
+    std::mutex mutex;
+    std::map<int, LiveRecord> live;
+    IonStatsEntry total;
+    std::map<unsigned int, IonStatsEntry> by_heap;
+    std::map<std::string, IonStatsEntry> by_tag;
+
+    StatsRegistry()
+    {
+        memset(&total, 0, sizeof(total));
+    }
+};
+
+static StatsRegistry& registry()
+{
+    /* never destroyed, buffers may still be released by static destructors */
+    static StatsRegistry *stats = new StatsRegistry();
+
+    return *stats;
+}
+
+static IonStatsEntry& entry_of(std::map<unsigned int, IonStatsEntry>& entries, unsigned int key)
+{
+    std::map<unsigned int, IonStatsEntry>::iterator it = entries.find(key);
+
+    if (it == entries.end()) {
+        IonStatsEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        it = entries.insert(std::make_pair(key, entry)).first;
+    }
+
+    return it->second;
+}
+
+static IonStatsEntry& entry_of(std::map<std::string, IonStatsEntry>& entries, const std::string& key)
+{
+    std::map<std::string, IonStatsEntry>::iterator it = entries.find(key);
+
+    if (it == entries.end()) {
+        IonStatsEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        it = entries.insert(std::make_pair(key, entry)).first;
+    }
+
+    return it->second;
+}
+
+static void add_alloc(IonStatsEntry& entry, uint64_t len)
+{
+    entry.live_bytes += len;
+    entry.live_count++;
+    entry.alloc_count++;
+
+    if (entry.live_bytes > entry.peak_bytes) {
+        entry.peak_bytes = entry.live_bytes;
+    }
+}
+
+static void add_free(IonStatsEntry& entry, uint64_t len, int bucket)
+{
+    entry.live_bytes -= len;
+    entry.live_count--;
+    entry.free_count++;
+    entry.lifetime_histogram[bucket]++;
+}
+
+static int lifetime_bucket(double seconds)
+{
+    double limit = 0.001;
+
+    for (int bucket = 0; bucket < ION_LIFETIME_BUCKETS - 1; bucket++) {
+        if (seconds < limit) {
+            return bucket;
+        }
+        limit *= 10;
+    }
+
+    return ION_LIFETIME_BUCKETS - 1;
+}
+
+void ion_stats_on_alloc(int fd, uint64_t len, unsigned int heap_mask, const char *tag)
+{
+    StatsRegistry& stats = registry();
+    LiveRecord record;
+
+    record.len       = len;
+    record.heap_mask = heap_mask;
+    record.tag       = tag ? tag : ION_STATS_UNTAGGED;
+    record.allocated = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(stats.mutex);
+
+    add_alloc(stats.total, len);
+    add_alloc(entry_of(stats.by_heap, heap_mask), len);
+    add_alloc(entry_of(stats.by_tag, record.tag), len);
+    stats.live[fd] = record;
+}
+
+void ion_stats_on_free(int fd)
+{
+    StatsRegistry& stats = registry();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    std::map<int, LiveRecord>::iterator it = stats.live.find(fd);
+
+    if (it == stats.live.end()) {
+        return;
+    }
+
+    const LiveRecord& record = it->second;
+    double lifetime          = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - record.allocated).count();
+    int bucket = lifetime_bucket(lifetime);
+
+    add_free(stats.total, record.len, bucket);
+    add_free(entry_of(stats.by_heap, record.heap_mask), record.len, bucket);
+    add_free(entry_of(stats.by_tag, record.tag), record.len, bucket);
+    stats.live.erase(it);
+}
+
+IonStatsEntry ion_stats_total()
+{
+    StatsRegistry& stats = registry();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+
+    return stats.total;
+}
+
+std::map<unsigned int, IonStatsEntry> ion_stats_by_heap()
+{
+    StatsRegistry& stats = registry();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+
+    return stats.by_heap;
+}
+
+std::map<std::string, IonStatsEntry> ion_stats_by_tag()
+{
+    StatsRegistry& stats = registry();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+
+    return stats.by_tag;
+}
+
+std::vector<IonLiveBuffer> ion_stats_live_buffers()
+{
+    StatsRegistry& stats = registry();
+    std::vector<IonLiveBuffer> buffers;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(stats.mutex);
+
+    for (std::map<int, LiveRecord>::iterator it = stats.live.begin(); it != stats.live.end(); ++it) {
+        IonLiveBuffer buffer;
+        buffer.fd          = it->first;
+        buffer.len         = it->second.len;
+        buffer.heap_mask   = it->second.heap_mask;
+        buffer.tag         = it->second.tag;
+        buffer.age_seconds = std::chrono::duration<double>(now - it->second.allocated).count();
+        buffers.push_back(buffer);
+    }
+
+    return buffers;
+}
+
+static void write_json_entry(std::ostringstream& out, const IonStatsEntry& entry)
+{
+    out << "{\"live_bytes\":" << entry.live_bytes
+        << ",\"peak_bytes\":" << entry.peak_bytes
+        << ",\"live_count\":" << entry.live_count
+        << ",\"alloc_count\":" << entry.alloc_count
+        << ",\"free_count\":" << entry.free_count
+        << ",\"lifetime_histogram\":[";
+
+    for (int i = 0; i < ION_LIFETIME_BUCKETS; i++) {
+        out << (i ? "," : "") << entry.lifetime_histogram[i];
+    }
+    out << "]}";
+}
+
+static std::string json_escape(const std::string& text)
+{
+    std::string escaped;
+
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+
+        if ((c == '"') || (c == '\\')) {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char)c < 0x20) {
+            char hex[8];
+            snprintf(hex, sizeof(hex), "\\u%04x", c);
+            escaped += hex;
+        } else {
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+std::string ion_stats_json()
+{
+    StatsRegistry& stats = registry();
+    std::ostringstream out;
+
+    std::lock_guard<std::mutex> lock(stats.mutex);
+
+    out << "{\"lifetime_buckets_ms\":[1,10,100,1000,10000,100000,null],\"total\":";
+    write_json_entry(out, stats.total);
+
+    out << ",\"heaps\":{";
+
+    for (std::map<unsigned int, IonStatsEntry>::iterator it = stats.by_heap.begin();
+         it != stats.by_heap.end(); ++it) {
+        char key[16];
+        snprintf(key, sizeof(key), "0x%x", it->first);
+        out << (it == stats.by_heap.begin() ? "" : ",") << "\"" << key << "\":";
+        write_json_entry(out, it->second);
+    }
+
+    out << "},\"tags\":{";
+
+    for (std::map<std::string, IonStatsEntry>::iterator it = stats.by_tag.begin();
+         it != stats.by_tag.end(); ++it) {
+        out << (it == stats.by_tag.begin() ? "" : ",") << "\"" << json_escape(it->first) << "\":";
+        write_json_entry(out, it->second);
+    }
+
+    out << "}}";
+
+    return out.str();
+}
+
+static int dump_pipe[2] = { -1, -1 };
+
+static void dump_signal_handler(int)
+{
+    char byte   = 0;
+    int  saved  = errno;
+    ssize_t ret = write(dump_pipe[1], &byte, 1);
+
+    (void)ret;
+    errno = saved;
+}
+
+static void dump_thread(std::string path)
+{
+    char byte;
+
+    for (;;) {
+        ssize_t n = read(dump_pipe[0], &byte, 1);
+
+        /* errno only means something when read() failed; 0 is a closed pipe */
+        if ((n < 0) && (errno == EINTR)) {
+            continue;
+        } else if (n <= 0) {
+            break;
+        }
+
+        std::string json = ion_stats_json();
+        std::string temp = path + ".tmp";
+        FILE *file       = fopen(temp.c_str(), "w");
+
+        if (file == NULL) {
+            ERR("ion stats: cannot write %s", temp.c_str());
+            continue;
+        }
+        fwrite(json.data(), 1, json.size(), file);
+        fputc('\n', file);
+        fclose(file);
+        rename(temp.c_str(), path.c_str());
+        INFO("ion stats dumped to %s", path.c_str());
+    }
+}
+
+bool ion_stats_dump_on_signal(int signo, const char *path)
+{
+    static std::mutex install_mutex;
+    std::lock_guard<std::mutex> lock(install_mutex);
+
+    if (dump_pipe[0] >= 0) {
+        ERR("ion stats dump already installed");
+        return false;
+    }
+
+    if (pipe2(dump_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        return false;
+    }
+
+    /* only the writer end may drop bytes, the watcher blocks */
+    fcntl(dump_pipe[0], F_SETFL, 0);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = dump_signal_handler;
+    action.sa_flags   = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(signo, &action, NULL) < 0) {
+        close(dump_pipe[0]);
+        close(dump_pipe[1]);
+        dump_pipe[0] = dump_pipe[1] = -1;
+        return false;
+    }
+
+    std::thread(dump_thread, std::string(path)).detach();
+
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef __ION_STATS_HPP__
+#define __ION_STATS_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define ION_STATS_UNTAGGED "untagged"
+
+/* buffer lifetime buckets: <1ms, <10ms, <100ms, <1s, <10s, <100s, longer */
+#define ION_LIFETIME_BUCKETS 7
+
+struct IonStatsEntry {
+    uint64_t      live_bytes;
+    uint64_t      peak_bytes;
+    unsigned long live_count;
+    unsigned long alloc_count;
+    unsigned long free_count;
+    unsigned long lifetime_histogram[ION_LIFETIME_BUCKETS];
+};
+
+struct IonLiveBuffer {
+    int          fd;
+    uint64_t     len;
+    unsigned int heap_mask;
+    std::string  tag;
+    double       age_seconds;
+};
+
+/**
+ * record a new buffer, called by IonAllocator for every mapped buffer
+ * @param  fd        [shared fd, the key of the buffer]
+ * @param  len       [bytes]
+ * @param  heap_mask [ion heap mask, 0 for dma-buf heaps and memfd]
+ * @param  tag       [call-site tag, NULL for ION_STATS_UNTAGGED]
+ */
+void ion_stats_on_alloc(int fd, uint64_t len, unsigned int heap_mask, const char *tag);
+
+/**
+ * record the release of a buffer
+ * @param  fd [shared fd passed to ion_stats_on_alloc()]
+ */
+void ion_stats_on_free(int fd);
+
+/**
+ * @return [process totals]
+ */
+IonStatsEntry ion_stats_total();
+
+/**
+ * @return [stats per heap mask]
+ */
+std::map<unsigned int, IonStatsEntry> ion_stats_by_heap();
+
+/**
+ * @return [stats per call-site tag]
+ */
+std::map<std::string, IonStatsEntry> ion_stats_by_tag();
+
+/**
+ * @return [every buffer still alive]
+ */
+std::vector<IonLiveBuffer> ion_stats_live_buffers();
+
+/**
+ * @return [totals, per heap and per tag stats as a json object]
+ */
+std::string ion_stats_json();
+
+/**
+ * write ion_stats_json() to path whenever signo arrives (e.g. SIGUSR1).
+ * the handler only wakes a watcher thread, the dump itself runs there.
+ * @param  signo [signal to install the handler for]
+ * @param  path  [output file, replaced atomically]
+ * @return       [true for success]
+ */
+bool ion_stats_dump_on_signal(int signo, const char *path);
+
+#endif // ifndef __ION_STATS_HPP__
@@ -1,87 +1,491 @@
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <stdio.h>
 #include <iostream>
+#include <mutex>
+#include <vector>
 
 #include "ion_wrapper.hpp"
+#include "ion_backend.hpp"
+#include "ion_stats.hpp"
 
-int ion_free(IonBuffer& ionBuf)
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+static void report_leaks()
 {
-    int ion_device_fd = -1, rc = 0;
+    std::vector<IonLiveBuffer> buffers = ion_stats_live_buffers();
+    uint64_t total = 0;
 
-    ion_device_fd = open("/dev/ion", O_RDONLY);
+    for (size_t i = 0; i < buffers.size(); i++) {
+        ERR("ION LEAK fd %d size %llu tag %s", buffers[i].fd,
+            (unsigned long long)buffers[i].len, buffers[i].tag.c_str());
+        fprintf(stderr, "ion leak: fd %d, %llu bytes, tag %s, age %.3f s\n", buffers[i].fd,
+                (unsigned long long)buffers[i].len, buffers[i].tag.c_str(), buffers[i].age_seconds);
+        total += buffers[i].len;
+    }
 
-    if (ion_device_fd < 0) {
-        ERR("ERROR: ION Device open() Failed %d", ion_device_fd);
-        return -2;
+    if (!buffers.empty()) {
+        fprintf(stderr, "ion leak: %zu buffers, %llu bytes still allocated at exit\n",
+                buffers.size(), (unsigned long long)total);
     }
+}
 
-    munmap(ionBuf.vaddr, ionBuf.alloc_data.len);
+void ion_enable_leak_report()
+{
+    static std::once_flag once;
 
-    // struct ion_handle_data data;
-    // data.handle = ionBuf.alloc_data.handle;
-    // rc = ioctl(ion_device_fd, ION_IOC_FREE, &data);
+    std::call_once(once, []() {
+        atexit(report_leaks);
+    });
+}
 
-    close(ion_device_fd);
+/* ION_LEAK_CHECK, read once by every allocation path whatever the allocator */
+static void check_leak_env()
+{
+    static std::once_flag once;
 
-    return rc;
+    std::call_once(once, []() {
+        if (getenv("ION_LEAK_CHECK")) {
+            ion_enable_leak_report();
+        }
+    });
 }
 
-int ion_allocate(int size, IonBuffer& ionBuf)
+IonBuffer::IonBuffer()
 {
-    int ion_device_fd = -1, rc = 0;
+    clear();
+}
 
-    if ((size <= 0)) {
-        ERR("Invalid input to alloc_map_ion_memory");
-        rc = -1;
-        goto ret;
+IonBuffer::~IonBuffer()
+{
+    reset();
+}
+
+IonBuffer::IonBuffer(IonBuffer&& other) noexcept
+    : ion_device_fd(other.ion_device_fd),
+      fd(other.fd),
+      size(other.size),
+      align(other.align),
+      flags(other.flags),
+      heap_mask(other.heap_mask),
+      handle(other.handle),
+      vaddr(other.vaddr),
+      backend(other.backend)
+{
+    other.clear();
+}
+
+IonBuffer& IonBuffer::operator=(IonBuffer&& other) noexcept
+{
+    if (this != &other) {
+        reset();
+        ion_device_fd = other.ion_device_fd;
+        fd            = other.fd;
+        size          = other.size;
+        align         = other.align;
+        flags         = other.flags;
+        heap_mask     = other.heap_mask;
+        handle        = other.handle;
+        vaddr         = other.vaddr;
+        backend       = other.backend;
+        other.clear();
     }
 
-    ion_device_fd = open("/dev/ion", O_RDONLY);
+    return *this;
+}
 
-    if (ion_device_fd < 0) {
-        ERR("ERROR: ION Device open() Failed");
-        rc = -2;
-        goto ret;
+void IonBuffer::clear()
+{
+    ion_device_fd     = -1;
+    fd                = -1;
+    size              = 0;
+    align             = 0;
+    flags             = 0;
+    heap_mask         = 0;
+    handle            = 0;
+    vaddr             = NULL;
+    backend           = NULL;
+}
+
+int IonBuffer::reset()
+{
+    int rc = 0;
+
+    if (vaddr != NULL) {
+        munmap(vaddr, size);
     }
 
-    /* to make it page size aligned */
-    ionBuf.alloc_data.len       = (size + 4095) & (~4095);
-    ionBuf.alloc_data.align     = 4096;
-    ionBuf.alloc_data.flags     = ION_FLAG_CACHED;
-    ionBuf.alloc_data.heap_mask = 1 << ION_IOMMU_HEAP_ID;
-    INFO("ION ALLOC unsec buf: size %d align %d flags %x",
-         (int)ionBuf.alloc_data.len,
-         (int)ionBuf.alloc_data.align, ionBuf.alloc_data.flags);
+    if (backend != NULL) {
+        rc = backend->release(*this);
+    }
+
+    if (fd >= 0) {
+        ion_stats_on_free(fd);
+        close(fd);
+    }
+
+    clear();
+
+    return rc;
+}
+
+static int allocate_on_backend(IonBackend *backend, uint64_t size, unsigned int flags,
+                               const char *tag, IonBuffer& ionBuf)
+{
+    int rc = 0;
 
-    rc = ioctl(ion_device_fd, ION_IOC_ALLOC, &ionBuf.alloc_data);
+    check_leak_env();
 
-    if (rc || !ionBuf.alloc_data.handle) {
-        ERR("ION ALLOC memory failed 0x%x", rc);
-        ionBuf.alloc_data.handle = NULL;
-        rc                       = -3;
-        goto close_ion;
+    if ((size == 0)) {
+        ERR("Invalid input to alloc_map_ion_memory");
+        return -1;
+    }
+
+    /* a 32-bit process cannot map it whole, only through windows */
+    if (!(flags & ION_ALLOC_UNMAPPED) && (size > SIZE_MAX - 4095)) {
+        ERR("ion buffer too large to map, use ION_ALLOC_UNMAPPED");
+        return -1;
     }
-    ionBuf.fd_data.handle = ionBuf.alloc_data.handle;
-    rc                    = ioctl(ion_device_fd, ION_IOC_SHARE, &ionBuf.fd_data);
+
+    ionBuf.reset();
+
+    /* to make it page size aligned */
+    rc = backend->allocate((size + 4095) & ~(uint64_t)4095, flags, ionBuf);
 
     if (rc) {
-        ERR("ION SHARE failed");
-        rc = -4;
-        goto close_ion;
+        return rc;
     }
+    ionBuf.backend = backend;
 
-    ionBuf.vaddr = mmap(NULL, ionBuf.alloc_data.len, PROT_READ | PROT_WRITE,
-                        MAP_SHARED, ionBuf.fd_data.fd, 0);
+    if (flags & ION_ALLOC_UNMAPPED) {
+        ion_stats_on_alloc(ionBuf.fd, ionBuf.size,
+                           ionBuf.heap_mask, tag);
+        return 0;
+    }
+
+    ionBuf.vaddr = mmap(NULL, ionBuf.size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | ((flags & ION_ALLOC_PREFAULT) ? MAP_POPULATE : 0),
+                        ionBuf.fd, 0);
 
     if (ionBuf.vaddr == MAP_FAILED) {
         ERR("mmap failed for ion!");
-        rc = -5;
-        goto close_ion;
+        ionBuf.vaddr = NULL;
+        ionBuf.reset();
+        return -5;
     }
-close_ion:
-    close(ion_device_fd);
-ret:
+
+    /* shmem backed buffers get transparent huge pages only on request */
+    if (flags & ION_ALLOC_HUGEPAGE) {
+        madvise(ionBuf.vaddr, ionBuf.size, MADV_HUGEPAGE);
+    }
+
+    ion_stats_on_alloc(ionBuf.fd, ionBuf.size,
+                       ionBuf.heap_mask, tag);
+
+    return 0;
+}
+
+int ion_cache_sync(const IonBuffer& ionBuf, IonCacheOp op,
+                   size_t offset, size_t length)
+{
+    if (!ionBuf.is_valid() || (offset >= ionBuf.size)) {
+        return -1;
+    }
+
+    if ((length == 0) || (length > ionBuf.size - offset)) {
+        length = ionBuf.size - offset;
+    }
+
+    if (ionBuf.backend == NULL) {
+        return dma_buf_sync_cache(ionBuf.fd, op);
+    }
+
+    return ionBuf.backend->sync_cache(ionBuf, op, ionBuf.vaddr, offset, length);
+}
+
+static int prefault_range(void *vaddr, size_t len)
+{
+    /* one call populating writable ptes, linux 5.14+ */
+    if (madvise(vaddr, len, MADV_POPULATE_WRITE) == 0) {
+        return 0;
+    }
+
+    if (errno != EINVAL) {
+        ERR("prefault failed %d", errno);
+        return -1;
+    }
+
+    /* older kernels: touch every page, reading keeps the content intact */
+    const volatile char *page = (const volatile char *)vaddr;
+
+    for (size_t offset = 0; offset < len; offset += 4096) {
+        (void)page[offset];
+    }
+
+    return 0;
+}
+
+int ion_prefault(const IonBuffer& ionBuf)
+{
+    if (ionBuf.vaddr == NULL) {
+        return -1;
+    }
+
+    return prefault_range(ionBuf.vaddr, ionBuf.size);
+}
+
+std::future<int> ion_prefault_async(const IonBuffer& ionBuf)
+{
+    if (ionBuf.vaddr == NULL) {
+        std::promise<int> unmapped;
+        unmapped.set_value(-1);
+        return unmapped.get_future();
+    }
+
+    /* by value, the IonBuffer object itself may be moved meanwhile */
+    return std::async(std::launch::async, prefault_range,
+                      ionBuf.vaddr, (size_t)ionBuf.size);
+}
+
+int ion_free(IonBuffer& ionBuf)
+{
+    return ionBuf.reset();
+}
+
+int ion_import(int fd, size_t size, IonBuffer& ionBuf)
+{
+    if ((fd < 0) || (size == 0)) {
+        ERR("Invalid input to ion_import");
+        return -1;
+    }
+
+    check_leak_env();
+    ionBuf.reset();
+
+    ionBuf.fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+
+    if (ionBuf.fd < 0) {
+        ERR("ion_import dup failed");
+        return -4;
+    }
+    ionBuf.size  = size;
+    ionBuf.align = 4096;
+
+    ionBuf.vaddr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ionBuf.fd, 0);
+
+    if (ionBuf.vaddr == MAP_FAILED) {
+        ERR("mmap failed for imported fd!");
+        ionBuf.vaddr = NULL;
+        ionBuf.reset();
+        return -5;
+    }
+
+    ion_stats_on_alloc(ionBuf.fd, size, 0, "import");
+
+    return 0;
+}
+
+int ion_allocate(uint64_t size, IonBuffer& ionBuf, const char *device_path)
+{
+    IonBackend *backend = ion_open_backend(device_path);
+
+    if (backend == NULL) {
+        return -2;
+    }
+
+    int rc = allocate_on_backend(backend, size, 0, NULL, ionBuf);
+
+    /*
+     * closing the per-call client frees its handles, the shared fd keeps
+     * the buffer alive until ion_free()
+     */
+    ionBuf.ion_device_fd = -1;
+    ionBuf.handle        = 0;
+    ionBuf.backend       = NULL;
+
+    delete backend;
+
     return rc;
 }
+
+IonAllocator::IonAllocator()
+    : backend_(ion_create_backend(ion_backend_type_from_name(getenv("ION_BACKEND"))))
+{
+    if (backend_ == NULL) {
+        ERR("ERROR: no ion backend available");
+    }
+}
+
+IonAllocator::IonAllocator(const char *device_path)
+    : backend_(ion_open_backend(device_path))
+{
+}
+
+IonAllocator::IonAllocator(IonBackend *backend)
+    : backend_(backend)
+{
+}
+
+IonAllocator::~IonAllocator()
+{
+    delete backend_;
+}
+
+IonAllocator& IonAllocator::instance()
+{
+    static IonAllocator allocator;
+
+    return allocator;
+}
+
+bool IonAllocator::is_stand_in() const
+{
+    return backend_ && backend_->type() == ION_BACKEND_MEMFD;
+}
+
+int IonAllocator::allocate(uint64_t size, IonBuffer& ionBuf, unsigned int flags,
+                           const char *tag)
+{
+    if (backend_ == NULL) {
+        return -2;
+    }
+
+    return allocate_on_backend(backend_, size, flags, tag, ionBuf);
+}
+
+int IonAllocator::share(IonBuffer& ionBuf)
+{
+    if (backend_ == NULL) {
+        return -2;
+    }
+
+    return backend_->share(ionBuf);
+}
+
+int IonAllocator::free(IonBuffer& ionBuf)
+{
+    return ionBuf.reset();
+}
+
+IonWindow::IonWindow()
+    : buffer_(NULL), map_base_(NULL), map_length_(0), data_(NULL), offset_(0), length_(0)
+{}
+
+IonWindow::~IonWindow()
+{
+    unmap();
+}
+
+IonWindow::IonWindow(IonWindow&& other) noexcept
+    : buffer_(other.buffer_),
+      map_base_(other.map_base_),
+      map_length_(other.map_length_),
+      data_(other.data_),
+      offset_(other.offset_),
+      length_(other.length_)
+{
+    other.map_base_ = NULL;
+    other.unmap();
+}
+
+IonWindow& IonWindow::operator=(IonWindow&& other) noexcept
+{
+    if (this != &other) {
+        unmap();
+        buffer_         = other.buffer_;
+        map_base_       = other.map_base_;
+        map_length_     = other.map_length_;
+        data_           = other.data_;
+        offset_         = other.offset_;
+        length_         = other.length_;
+        other.map_base_ = NULL;
+        other.unmap();
+    }
+
+    return *this;
+}
+
+int IonWindow::map(const IonBuffer& ionBuf, uint64_t offset, size_t length)
+{
+    if (!ionBuf.is_valid() || (length == 0) ||
+        (offset >= ionBuf.size) || (length > ionBuf.size - offset)) {
+        ERR("Invalid input to IonWindow::map");
+        return -1;
+    }
+
+    /*
+     * mmap offsets and lengths are multiples of the buffer's page size,
+     * 2 MB for hugetlb memory; the window starts inside the first page
+     */
+    uint64_t page       = (ionBuf.align > 4096) ? ionBuf.align : 4096;
+    uint64_t map_offset = offset / page * page;
+    size_t   head       = (size_t)(offset - map_offset);
+
+    if (length > SIZE_MAX - (page - 1) - head) {
+        ERR("Invalid input to IonWindow::map");
+        return -1;
+    }
+
+    size_t map_length = (size_t)((head + length + page - 1) / page * page);
+
+    /* sliding a window of the same size replaces the pages in place */
+    void *hint  = (map_length == map_length_) ? map_base_ : NULL;
+    void *vaddr = mmap(hint, map_length, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | (hint ? MAP_FIXED : 0),
+                       ionBuf.fd, (off_t)map_offset);
+
+    if (vaddr == MAP_FAILED) {
+        ERR("mmap failed for ion window!");
+        /* a failed MAP_FIXED leaves the old range in an unknown state */
+        if (hint != NULL) {
+            unmap();
+        }
+        return -5;
+    }
+
+    if ((hint == NULL) && (map_base_ != NULL)) {
+        munmap(map_base_, map_length_);
+    }
+
+    buffer_     = &ionBuf;
+    map_base_   = vaddr;
+    map_length_ = map_length;
+    data_       = (char *)vaddr + head;
+    offset_     = offset;
+    length_     = length;
+
+    return 0;
+}
+
+void IonWindow::unmap()
+{
+    if (map_base_ != NULL) {
+        munmap(map_base_, map_length_);
+    }
+
+    buffer_     = NULL;
+    map_base_   = NULL;
+    map_length_ = 0;
+    data_       = NULL;
+    offset_     = 0;
+    length_     = 0;
+}
+
+int IonWindow::sync(IonCacheOp op) const
+{
+    if (data_ == NULL) {
+        return -1;
+    }
+
+    if (buffer_->backend == NULL) {
+        return dma_buf_sync_cache(buffer_->fd, op);
+    }
+
+    return buffer_->backend->sync_cache(*buffer_, op, map_base_,
+                                        (char *)data_ - (char *)map_base_, length_);
+}
@@ -2,28 +2,269 @@
 #define __ION_WRAPPER_HPP__
 
 #include <stdlib.h>
-#include <linux/msm_ion.h>
-#include <syslog.h>
+#include <stdint.h>
+#include <future>
+#include "async_log.hpp"
 
-#define ERR(fmt, args ...)                                                \
-    do {                                                                  \
-        syslog(LOG_ERR, "E %d, " fmt, __LINE__, ## args); \
-    } while (0)
+/* queued to syslog by the async_log.hpp flusher, rate limited per call site */
+#define ERR(fmt, args ...)                                                 \
+    ASYNC_LOG_ERR(ASYNC_LOG_SYSLOG, "E %d, " fmt, __LINE__, ## args)
 
 #define INFO(fmt, args ...)                                                \
-    do {                                                                   \
-        syslog(LOG_INFO, "I %d, " fmt, __LINE__, ## args); \
-    } while (0)
+    ASYNC_LOG_INFO(ASYNC_LOG_SYSLOG, "I %d, " fmt, __LINE__, ## args)
 
+#define ION_DEVICE_PATH "/dev/ion"
+#define ION_HUGE_PAGE_SIZE (2 * 1024 * 1024) // ION_ALLOC_HUGEPAGE rounds lengths to this
+
+/* allocation options, 0 is a cached (write-back) host mapping */
+enum IonAllocFlag {
+    ION_ALLOC_UNCACHED = 1 << 0, // host mapping bypasses cpu caches
+    ION_ALLOC_PREFAULT = 1 << 1, // populate the page tables in mmap (MAP_POPULATE)
+    ION_ALLOC_HUGEPAGE = 1 << 2, // 2 MB host pages where the backend can map them
+    ION_ALLOC_UNMAPPED = 1 << 3, // no host mapping, vaddr stays NULL; see IonWindow
+};
+
+class IonBackend;
+
+/**
+ * move-only owner of one ion buffer: the mapping, the shared fd and the
+ * backend handle are released when the buffer is destroyed or reset().
+ *
+ * the allocator (and so the backend) that filled the buffer must outlive it.
+ */
 struct IonBuffer {
     int ion_device_fd;
-    struct ion_fd_data fd_data;
-    struct ion_allocation_data alloc_data;
-    void *vaddr;
+    int fd;              // shareable dma-buf or memfd fd, -1 if empty
+    uint64_t size;       // bytes
+    uint64_t align;      // mapping granularity, ION_HUGE_PAGE_SIZE for hugetlb memory
+    unsigned int flags;  // IonAllocFlag bits the memory honours
+    unsigned int heap_mask; // legacy ion heap the buffer came from, 0 otherwise
+    uintptr_t handle;    // legacy ion handle, 0 if there is none
+    void *vaddr;         // whole buffer mapping, NULL for ION_ALLOC_UNMAPPED
+    IonBackend *backend; // releases handle, NULL if there is none
+
+    IonBuffer();
+    ~IonBuffer();
+
+    IonBuffer(IonBuffer&& other) noexcept;
+    IonBuffer& operator=(IonBuffer&& other) noexcept;
+
+    /**
+     * unmap, free the handle and close the shared fd; the buffer is empty
+     * afterwards
+     * @return [0 for success, ION_IOC_FREE error otherwise]
+     */
+    int reset();
+
+    /**
+     * @return [true if the buffer holds memory]
+     */
+    bool is_valid() const { return fd >= 0; }
+
+private:
+    IonBuffer(const IonBuffer&) = delete;
+    IonBuffer& operator=(const IonBuffer&) = delete;
+
+    void clear();
 };
 
-int ion_allocate(int size, IonBuffer &ionBuf);
+int ion_allocate(uint64_t size, IonBuffer &ionBuf,
+                 const char *device_path = ION_DEVICE_PATH);
 
 int ion_free(IonBuffer &ionBuf);
 
+/**
+ * map a buffer fd produced elsewhere (dma-buf or memfd); ionBuf owns a dup
+ * of the fd, so the producer may close its own copy
+ * @param  fd     [buffer fd]
+ * @param  size   [bytes to map]
+ * @param  ionBuf [return buffer, no backend handle]
+ * @return        [0 for success, -1 invalid input, -4 dup failed, -5 mmap failed]
+ */
+int ion_import(int fd, size_t size, IonBuffer &ionBuf);
+
+/**
+ * print the buffers still alive when the process exits (to syslog and
+ * stderr), as recorded by ion_stats.hpp. also enabled by setting the
+ * ION_LEAK_CHECK environment variable, read at the first allocation or
+ * import through any allocator.
+ */
+void ion_enable_leak_report();
+
+enum IonCacheOp {
+    ION_CACHE_CLEAN            = 1, // write cpu caches back, before the device reads
+    ION_CACHE_INVALIDATE       = 2, // drop cpu caches, before the cpu reads device output
+    ION_CACHE_CLEAN_INVALIDATE = 3,
+};
+
+/**
+ * cpu cache maintenance of a cached (write-back) mapping. legacy ion
+ * buffers honour the byte range; dma-buf fds only sync whole buffers, so
+ * the range is widened there.
+ * @param  ionBuf [mapped buffer]
+ * @param  op     [clean, invalidate or both]
+ * @param  offset [first byte]
+ * @param  length [bytes, 0 up to the end of the buffer]
+ * @return        [0 for success, -1 invalid range, -6 sync ioctl failed]
+ */
+int ion_cache_sync(const IonBuffer& ionBuf, IonCacheOp op,
+                   size_t offset = 0, size_t length = 0);
+
+/**
+ * fault in every page of the mapping now, so the first frame does not
+ * take one page fault per 4 KB page
+ * @param  ionBuf [mapped buffer]
+ * @return        [0 for success, -1 not mapped or populate failed]
+ */
+int ion_prefault(const IonBuffer& ionBuf);
+
+/**
+ * ion_prefault() on a background thread, to overlap the warm-up with the
+ * rest of the startup. the mapping must stay alive until the future is
+ * ready; moving the IonBuffer is fine.
+ * @param  ionBuf [mapped buffer]
+ * @return        [result of ion_prefault()]
+ */
+std::future<int> ion_prefault_async(const IonBuffer& ionBuf);
+
+/**
+ * ion client that keeps its backend (the ion device, a dma-buf heap or the
+ * memfd stand-in, see ion_backend.hpp) open for its whole lifetime, so the
+ * allocation path costs only the ioctls and the mmap.
+ *
+ * all methods only read the backend after construction, so one instance
+ * can be shared by any number of threads.
+ */
+class IonAllocator {
+public:
+    /**
+     * probe legacy ion, dma-buf heaps and memfd in that order; the ION_BACKEND
+     * environment variable (ion, dma_heap or memfd) forces one of them
+     */
+    IonAllocator();
+
+    /**
+     * @param  device_path [legacy ion device; anything that is not a
+     *                      character device, e.g. a memfd under /proc/self/fd,
+     *                      selects the memfd stand-in]
+     */
+    explicit IonAllocator(const char *device_path);
+
+    /**
+     * @param  backend [backend to allocate from, owned by the allocator]
+     */
+    explicit IonAllocator(IonBackend *backend);
+
+    ~IonAllocator();
+
+    /**
+     * process wide allocator on the probed backend, created on first use
+     * @return [shared allocator]
+     */
+    static IonAllocator& instance();
+
+    /**
+     * @return [true if a backend is available]
+     */
+    bool is_valid() const { return backend_ != NULL; }
+
+    /**
+     * @return [true if buffers are memfd stand-ins]
+     */
+    bool is_stand_in() const;
+
+    /**
+     * @return [backend in use, NULL if none]
+     */
+    IonBackend *backend() const { return backend_; }
+
+    /**
+     * allocate, share and map a page aligned buffer. buffers larger than
+     * the address space need ION_ALLOC_UNMAPPED and an IonWindow
+     * @param  size   [requested bytes]
+     * @param  ionBuf [return buffer]
+     * @param  flags  [IonAllocFlag bits]
+     * @param  tag    [call-site tag for ion_stats.hpp, a string literal]
+     * @return        [0 for success, same error codes as ion_allocate]
+     */
+    int allocate(uint64_t size, IonBuffer& ionBuf, unsigned int flags = 0,
+                 const char *tag = NULL);
+
+    /**
+     * export the buffer handle as a dma-buf fd into ionBuf.fd
+     * @param  ionBuf [allocated buffer]
+     * @return        [0 for success]
+     */
+    int share(IonBuffer& ionBuf);
+
+    /**
+     * unmap the buffer, free its handle and close the shared fd, same as
+     * ionBuf.reset()
+     * @param  ionBuf [allocated buffer]
+     * @return        [0 for success]
+     */
+    int free(IonBuffer& ionBuf);
+
+private:
+    IonAllocator(const IonAllocator&) = delete;
+    IonAllocator& operator=(const IonAllocator&) = delete;
+
+    IonBackend *backend_;
+};
+
+/**
+ * move-only host mapping of one range of a buffer, e.g. to stream through
+ * an ION_ALLOC_UNMAPPED buffer with a small host footprint. map() again to
+ * slide the window; a window of the same length reuses its address range.
+ *
+ * the buffer must outlive the window.
+ */
+class IonWindow {
+public:
+    IonWindow();
+    ~IonWindow();
+
+    IonWindow(IonWindow&& other) noexcept;
+    IonWindow& operator=(IonWindow&& other) noexcept;
+
+    /**
+     * map [offset, offset + length) of the buffer, replacing the current
+     * range; offset needs no alignment
+     * @param  ionBuf [allocated buffer, mapped or not]
+     * @param  offset [first byte in the buffer]
+     * @param  length [bytes]
+     * @return        [0 for success, -1 invalid range, -5 mmap failed]
+     */
+    int map(const IonBuffer& ionBuf, uint64_t offset, size_t length);
+
+    void unmap();
+
+    /**
+     * cpu cache maintenance of the window range, see ion_cache_sync()
+     * @param  op [clean, invalidate or both]
+     * @return    [0 for success, -1 not mapped, -6 sync ioctl failed]
+     */
+    int sync(IonCacheOp op) const;
+
+    /**
+     * @return [host address of offset(), NULL if not mapped]
+     */
+    void *data() const { return data_; }
+
+    uint64_t offset() const { return offset_; }
+
+    size_t length() const { return length_; }
+
+private:
+    IonWindow(const IonWindow&) = delete;
+    IonWindow& operator=(const IonWindow&) = delete;
+
+    const IonBuffer *buffer_;
+    void *map_base_;   // page aligned start of the mapping
+    size_t map_length_;
+    void *data_;
+    uint64_t offset_;
+    size_t length_;
+};
+
 #endif // ifndef __ION_WRAPPER_HPP__
@@ -1,9 +1,12 @@
-#include "ion_wrapper.hpp"
+#include "buffer_factory.hpp"
 #include "ocl/cl_common.hpp"
 #include "ocl/cl_wrapper.hpp"
+#include "ocl/cl_device_select.hpp"
+#include "ocl/cl_program_cache.hpp"
+#include "ocl/cl_kernel_registry.hpp"
 #include "ocl/cl_mac_debug_tools.hpp"
+#include "gen/cl_sources.hpp"
 
-#include <CL/cl_ext_qcom.h>
 #include <iostream>
 #include <cstdlib>
 
@@ -11,7 +14,6 @@ PROFILE_INIT(map_time_malloc, true);
 PROFILE_INIT(map_time_ion, true);
 int main(int argc, const char *argv[])
 {
-    int rv = 0;
     cl::Context context;
     cl::CommandQueue command_queue;
     bool succee_flag = true;
@@ -20,41 +22,61 @@ int main(int argc, const char *argv[])
 
     const int buffer_size = 1024 * 1024 * 128;
 
-    IonBuffer ion_ptr;
-    cl_mem_ion_host_ptr cl_ion_ptr;
+    BufferFactory factory;
+    ZeroCopyBuffer zero_copy;
 
-    CreateContext(context);
+    std::vector<RankedDevice> ranked;
+
+    if (!CreateContext(context, ranked)) {
+        exit(-3);
+    }
+    PrintRankedDevices(ranked);
     GetDeivces(context, devices);
+
+    /* the build runs while the queue and the buffers are set up */
+    std::vector<ClSourceBlob> sources(1, cl_source_hello);
+    ProgramCache program_cache;
+    std::future<bool> program_built = CreateProgramAsync(context,
+                                                         devices,
+                                                         sources,
+                                                         program,
+                                                         &program_cache);
+
     CreateCommandQueue(context, command_queue, devices.front());
 
-    std::vector<std::string> filenames;
-    filenames.push_back("cl/hello.cl");
-    succee_flag = CreateProgram(context,
-                                devices,
-                                filenames,
-                                program);
+    /* ion where cl_qcom_ion_host_ptr exists, the best portable zero-copy elsewhere */
+    factory.init(context, devices.front());
+    factory.set_huge_page_threshold(ION_HUGE_PAGE_SIZE);
 
-    cl::Kernel hello_kernel = cl::Kernel(program, "hello");
+    bool buffer_created = factory.create(buffer_size, ACCESS_DEVICE_WRITE_HOST_READ, zero_copy);
+
+    succee_flag = program_built.get();
 
     if (!succee_flag) {
         exit(-1);
     }
 
-    rv = ion_allocate(buffer_size, ion_ptr);
-
-    if (rv < 0) {
+    if (!buffer_created) {
         exit(-2);
     }
 
-    cl_ion_ptr.ext_host_ptr.allocation_type = CL_MEM_ION_HOST_PTR_QCOM;
-    cl_ion_ptr.ext_host_ptr.host_cache_policy = CL_MEM_HOST_UNCACHED_QCOM;
-    cl_ion_ptr.ion_filedesc = ion_ptr.fd_data.fd;
-    cl_ion_ptr.ion_hostptr = ion_ptr.vaddr;
+    KernelRegistry kernels;
+    cl::Kernel    *hello = NULL;
 
-    cl::Buffer buffer_ion = cl::Buffer(context,
-                                       CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR | CL_MEM_EXT_HOST_PTR_QCOM,
-                                       buffer_size,
-                                       &cl_ion_ptr);
+    if (kernels.init(program, devices.front())) {
+        hello = kernels.kernel(kernels.lookup("hello"));
+    }
+
+    if (hello == NULL) {
+        exit(-1);
+    }
+
+    cl::Kernel& hello_kernel = *hello;
+
+    std::cout << "zero-copy strategy: "
+              << BufferAllocTypeToString(factory.zero_copy_strategy()) << std::endl;
+
+    cl::Buffer buffer_ion = zero_copy.buffer();
 
     hello_kernel.setArg(0, buffer_ion);
     cl::NDRange global = cl::NDRange(buffer_size / sizeof(int));
@@ -65,11 +87,11 @@ int main(int argc, const char *argv[])
     command_queue.finish();
 
     PROFILE_IN(map_time_ion);
-    int *pclresult = (int *)command_queue.enqueueMapBuffer(buffer_ion,
-                                                           CL_TRUE,
-                                                           CL_MAP_READ,
-                                                           0,
-                                                           buffer_size);
+    int *pclresult = (int *)zero_copy.begin_host_access(command_queue, CL_MAP_READ);
+
+    if (pclresult == NULL) {
+        exit(-4);
+    }
 
     for (int i = 0; i < buffer_size / sizeof(int); i++) {
         if (i != pclresult[i]) {
@@ -78,10 +100,12 @@ int main(int argc, const char *argv[])
         }
     }
 
-    command_queue.enqueueUnmapMemObject(buffer_ion, pclresult);
+    zero_copy.end_host_access(command_queue, pclresult);
     command_queue.finish();
 
-    PROFILE_OUT(map_time_ion);   // 333ms
+    /* default config of the pattern; 333ms on the uncached ion buffer this
+       used before BufferFactory, the malloc ratio below is against that */
+    PROFILE_OUT(map_time_ion);
 
     cl::Buffer buffer_malloc = cl::Buffer(context,
                                           CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
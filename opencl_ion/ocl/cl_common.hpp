@@ -1,8 +1,11 @@
 #ifndef _OPENCL_CL_COMMON_HPP_
 #define _OPENCL_CL_COMMON_HPP_
 
+#include <sstream>
 #include <string>
 
+#include "../async_log.hpp"
+
 #define RETURE_FLASE_IF_NULL(para, info)     \
     if (para == NULL) {                      \
         std::cerr << info << __FILE__ << ":" \
@@ -10,8 +13,25 @@
         return false;                        \
     }
 
-#define CL_WARN(info) \
-    std::cout << "warn:" << info << __FILE__ << ":" << __LINE__ << std::endl
+/*
+ * formatted here, written to stdout by the async_log.hpp flusher; same level
+ * gate and per call site rate limit as ASYNC_LOG_WARN, checked before the
+ * stream is built
+ */
+#if ASYNC_LOG_LEVEL >= LOG_WARNING
+#define CL_WARN(info)                                                          \
+    do {                                                                       \
+        static AsyncLogSite cl_warn_site_;                                     \
+        if (async_log_allow(&cl_warn_site_)) {                                 \
+            std::ostringstream cl_warn_stream_;                                \
+            cl_warn_stream_ << "warn:" << info << __FILE__ << ":" << __LINE__; \
+            async_log_write(&cl_warn_site_, LOG_WARNING, ASYNC_LOG_STDOUT,     \
+                            "%s", cl_warn_stream_.str().c_str());              \
+        }                                                                      \
+    } while (0)
+#else
+#define CL_WARN(info) do {} while (0)
+#endif
 
 bool SaveToBitmap(std::string          filename,
                   int                  width,
@@ -0,0 +1,302 @@
+#include "cl_device_select.hpp"
+#include "cl_common.hpp"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+using namespace cl;
+
+/* score weights, see RankDevices() */
+#define DEVICE_SCORE_THROUGHPUT 2.0 // per doubling of compute units x MHz
+#define DEVICE_SCORE_GLOBAL_MEM 1.0 // per doubling of global MB
+#define DEVICE_SCORE_LOCAL_MEM  0.5 // per doubling of local KB
+
+static std::string Lower(std::string text)
+{
+    for (size_t i = 0; i < text.size(); i++) {
+        text[i] = (char)tolower((unsigned char)text[i]);
+    }
+
+    return (text);
+}
+
+static std::string Trim(const std::string& text)
+{
+    size_t begin = text.find_first_not_of(" \t\r\n");
+
+    if (begin == std::string::npos) {
+        return ("");
+    }
+
+    return (text.substr(begin, text.find_last_not_of(" \t\r\n") - begin + 1));
+}
+
+static void SplitWords(const std::string& text, std::vector<std::string>& words)
+{
+    std::istringstream stream(text);
+    std::string word;
+
+    while (stream >> word) {
+        words.push_back(word);
+    }
+}
+
+/**
+ * [read "key = value" lines, '#' starts a comment; a missing file is no error]
+ * @param  filename   [config file]
+ * @param  selector   [return "device" value, left alone if absent]
+ * @param  extensions [append "require" values]
+ */
+static void ReadDeviceConfig(const std::string       & filename,
+                             std::string             & selector,
+                             std::vector<std::string>& extensions)
+{
+    std::ifstream file(filename.c_str());
+    std::string   line;
+
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+
+        size_t equal = line.find('=');
+
+        if (equal == std::string::npos) {
+            continue;
+        }
+
+        std::string key   = Trim(line.substr(0, equal));
+        std::string value = Trim(line.substr(equal + 1));
+
+        if (key == "device") {
+            selector = value;
+        } else if (key == "require") {
+            SplitWords(value, extensions);
+        } else if (!key.empty()) {
+            CL_WARN("Unknown key \"" + key + "\" in " + filename + " ");
+        }
+    }
+}
+
+static bool HasExtensions(const std::string             & device_extensions,
+                          const std::vector<std::string>& required)
+{
+    std::vector<std::string> available;
+
+    SplitWords(device_extensions, available);
+
+    for (size_t i = 0; i < required.size(); i++) {
+        if (std::find(available.begin(), available.end(), required[i]) == available.end()) {
+            return (false);
+        }
+    }
+
+    return (true);
+}
+
+static double ScoreDevice(const RankedDevice& ranked)
+{
+    return (DEVICE_SCORE_THROUGHPUT * log2(1.0 + (double)ranked.compute_units * ranked.clock_mhz)
+            + DEVICE_SCORE_GLOBAL_MEM * log2(1.0 + (double)(ranked.global_mem_size >> 20))
+            + DEVICE_SCORE_LOCAL_MEM * log2(1.0 + (double)(ranked.local_mem_size >> 10)));
+}
+
+/* a gpu compute unit is many lanes wide, a cpu one is a core: the score
+   cannot compare them, so the type orders first */
+static int TypeOrder(cl_device_type type)
+{
+    if (type & CL_DEVICE_TYPE_GPU) {
+        return (2);
+    }
+
+    if (type & CL_DEVICE_TYPE_ACCELERATOR) {
+        return (1);
+    }
+
+    return (0);
+}
+
+/**
+ * [mark the devices the selector names, see RankDevices()]
+ * @param  selector [index, type or name substring]
+ * @param  ranked   [devices in score order]
+ * @return          [true if any device matched]
+ */
+static bool PinDevices(const std::string& selector, std::vector<RankedDevice>& ranked)
+{
+    std::string wanted = Lower(selector);
+    char       *end    = NULL;
+    long        index  = strtol(wanted.c_str(), &end, 10);
+    bool        found  = false;
+
+    if (!wanted.empty() && *end == '\0') {
+        if (index >= 0 && (size_t)index < ranked.size()) {
+            ranked[index].pinned = true;
+            found = true;
+        }
+
+        return (found);
+    }
+
+    cl_device_type type = 0;
+
+    if (wanted == "gpu") {
+        type = CL_DEVICE_TYPE_GPU;
+    } else if (wanted == "cpu") {
+        type = CL_DEVICE_TYPE_CPU;
+    } else if (wanted == "accelerator") {
+        type = CL_DEVICE_TYPE_ACCELERATOR;
+    }
+
+    for (size_t i = 0; i < ranked.size(); i++) {
+        if ((type != 0) ? (ranked[i].type & type) != 0
+            : Lower(ranked[i].name).find(wanted) != std::string::npos) {
+            ranked[i].pinned = true;
+            found = true;
+        }
+    }
+
+    return (found);
+}
+
+bool RankDevices(std::vector<RankedDevice>     & ranked,
+                 const std::vector<std::string>& required_extensions)
+{
+    std::vector<std::string> extensions(required_extensions);
+    std::string selector;
+
+    const char *config = getenv("OPENCL_DEVICE_CONFIG");
+
+    ReadDeviceConfig(config != NULL ? config : DEVICE_CONFIG_FILE, selector, extensions);
+
+    const char *device_env = getenv("OPENCL_DEVICE");
+
+    if (device_env != NULL) {
+        selector = device_env;
+    }
+
+    ranked.clear();
+
+    std::vector<Platform> platforms;
+
+    if (Platform::get(&platforms) != CL_SUCCESS || platforms.empty()) {
+        CL_WARN("No OpenCL platforms found. ");
+        return (false);
+    }
+
+    for (size_t p = 0; p < platforms.size(); p++) {
+        std::vector<Device> devices;
+        std::string platform_name;
+
+        /* CL_DEVICE_NOT_FOUND for a platform without devices */
+        if (platforms[p].getDevices(CL_DEVICE_TYPE_ALL, &devices) != CL_SUCCESS) {
+            continue;
+        }
+
+        platforms[p].getInfo(CL_PLATFORM_NAME, &platform_name);
+
+        for (size_t d = 0; d < devices.size(); d++) {
+            RankedDevice candidate;
+            std::string  device_name, device_extensions;
+            cl_bool      available = CL_FALSE;
+
+            devices[d].getInfo(CL_DEVICE_AVAILABLE, &available);
+            devices[d].getInfo(CL_DEVICE_NAME, &device_name);
+            devices[d].getInfo(CL_DEVICE_EXTENSIONS, &device_extensions);
+
+            if (!available || !HasExtensions(device_extensions, extensions)) {
+                continue;
+            }
+
+            candidate.device          = devices[d];
+            candidate.platform        = platforms[p]();
+            candidate.name            = Trim(platform_name.c_str()) + " / " + Trim(device_name.c_str());
+            candidate.type            = devices[d].getInfo<CL_DEVICE_TYPE>();
+            candidate.compute_units   = devices[d].getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+            candidate.clock_mhz       = devices[d].getInfo<CL_DEVICE_MAX_CLOCK_FREQUENCY>();
+            candidate.global_mem_size = devices[d].getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+            candidate.local_mem_size  = devices[d].getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+            candidate.score           = ScoreDevice(candidate);
+            candidate.pinned          = false;
+
+            ranked.push_back(candidate);
+        }
+    }
+
+    if (ranked.empty()) {
+        CL_WARN("No available OpenCL device has the required extensions. ");
+        return (false);
+    }
+
+    /* stable, so equal scores keep platform order */
+    std::stable_sort(ranked.begin(), ranked.end(),
+                     [](const RankedDevice& a, const RankedDevice& b) {
+        if (TypeOrder(a.type) != TypeOrder(b.type)) {
+            return (TypeOrder(a.type) > TypeOrder(b.type));
+        }
+
+        return (a.score > b.score);
+    });
+
+    if (!selector.empty()) {
+        if (PinDevices(selector, ranked)) {
+            std::stable_partition(ranked.begin(), ranked.end(),
+                                  [](const RankedDevice& ranked_device) {
+                return (ranked_device.pinned);
+            });
+        } else {
+            CL_WARN("No OpenCL device matches \"" + selector + "\", using the ranking. ");
+        }
+    }
+
+    return (true);
+}
+
+bool CreateContext(Context                  & context,
+                   std::vector<RankedDevice>& ranked,
+                   size_t                     max_devices)
+{
+    if (!RankDevices(ranked)) {
+        return (false);
+    }
+
+    std::vector<Device> devices;
+    cl_platform_id      platform = ranked.front().platform;
+
+    for (size_t i = 0; i < ranked.size() && devices.size() < max_devices; i++) {
+        if (ranked[i].platform == platform) {
+            devices.push_back(ranked[i].device);
+        }
+    }
+
+    cl_context_properties context_properties[] =
+    { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
+    cl_int error_number = 0;
+
+    context = Context(devices, context_properties, NULL, NULL, &error_number);
+
+    if (error_number != CL_SUCCESS) {
+        CL_WARN("Failed to create a context on " + ranked.front().name + " ");
+        return (false);
+    }
+
+    return (true);
+}
+
+void PrintRankedDevices(const std::vector<RankedDevice>& ranked)
+{
+    printf("%-4s %8s %5s %6s %10s %8s  %s\n",
+           "rank", "score", "cu", "mhz", "global_mb", "local_kb", "device");
+
+    for (size_t i = 0; i < ranked.size(); i++) {
+        printf("%-4zu %8.2f %5u %6u %10llu %8llu  %s%s\n", i, ranked[i].score,
+               ranked[i].compute_units, ranked[i].clock_mhz,
+               (unsigned long long)(ranked[i].global_mem_size >> 20),
+               (unsigned long long)(ranked[i].local_mem_size >> 10),
+               ranked[i].name.c_str(), ranked[i].pinned ? " (selected)" : "");
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef _OPENCL_CL_DEVICE_SELECT_H_
+#define _OPENCL_CL_DEVICE_SELECT_H_
+
+#if !(defined(__APPLE__) || defined(__MACOSX))
+#include "CL/cl.hpp"
+#else
+#include "cl.hpp"
+#endif
+
+#include <string>
+#include <vector>
+
+#define DEVICE_CONFIG_FILE "opencl_device.conf" // default config, see RankDevices()
+
+/* one device of any platform with the properties it was ranked by */
+struct RankedDevice {
+    cl::Device     device;
+    cl_platform_id platform;
+    std::string    name;          // "<platform name> / <device name>"
+    cl_device_type type;
+    cl_uint        compute_units;
+    cl_uint        clock_mhz;
+    cl_ulong       global_mem_size;
+    cl_ulong       local_mem_size;
+    double         score;
+    bool           pinned;        // matched the OPENCL_DEVICE / config override
+};
+
+/**
+ * [find the available devices of every platform and rank them, best first:
+ *  gpus, then accelerators, then cpus, each by score. the score adds log2
+ *  of compute units x clock, of global and of local memory size.
+ *
+ *  devices matching the override are moved to the front. the override is
+ *  the OPENCL_DEVICE environment variable, else the "device" key of the
+ *  config file ($OPENCL_DEVICE_CONFIG or DEVICE_CONFIG_FILE):
+ *      device  = 1          index into the ranking without override
+ *      device  = gpu        type: gpu, cpu or accelerator
+ *      device  = Adreno     case-insensitive substring of the name
+ *      require = cl_khr_fp16 cl_qcom_ion_host_ptr
+ *  "require" adds to required_extensions]
+ * @param  ranked              [return devices, best first]
+ * @param  required_extensions [devices lacking one are left out]
+ * @return                     [true if at least one device remains]
+ */
+bool RankDevices(std::vector<RankedDevice>     & ranked,
+                 const std::vector<std::string>& required_extensions = std::vector<std::string>());
+
+/**
+ * [create a context on the best ranked device and, up to max_devices, the
+ *  next ones of the same platform (a context cannot span platforms)]
+ * @param  context     [the new context]
+ * @param  ranked      [return the full ranking, see RankDevices()]
+ * @param  max_devices [devices to put in the context]
+ * @return             [true for success]
+ */
+bool CreateContext(cl::Context              & context,
+                   std::vector<RankedDevice>& ranked,
+                   size_t                     max_devices = 1);
+
+/**
+ * [print the ranking, one line per device]
+ * @param  ranked [from RankDevices()]
+ */
+void PrintRankedDevices(const std::vector<RankedDevice>& ranked);
+
+#endif // ifndef _OPENCL_CL_DEVICE_SELECT_H_
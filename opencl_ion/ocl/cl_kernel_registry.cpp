@@ -0,0 +1,198 @@
+#include "cl_kernel_registry.hpp"
+#include "cl_common.hpp"
+#include "cl_wrapper.hpp"
+
+#include <string.h>
+
+using namespace std;
+using namespace cl;
+
+#define KERNEL_THREAD_CACHE 4 // registries a thread finds without the mutex
+
+static std::atomic<unsigned long> next_registry_id(1);
+
+/* per-thread: the kernel sets of the registries this thread used last */
+struct KernelThreadCache {
+    struct Entry {
+        unsigned long registry_id; // 0 if empty
+        void         *kernels;     // KernelRegistry::ThreadKernels
+    };
+
+    Entry    entries[KERNEL_THREAD_CACHE];
+    unsigned next;
+};
+
+static thread_local KernelThreadCache thread_cache;
+
+static bool SupportsCloneKernel(const Device& device)
+{
+#ifdef CL_VERSION_2_1
+    return (IsDeviceVersionAtLeast(device, 2, 1));
+#else
+    (void)device;
+    return (false);
+#endif
+}
+
+KernelRegistry::KernelRegistry()
+    : id_(next_registry_id++), use_clone_(false)
+{}
+
+KernelRegistry::~KernelRegistry()
+{
+    for (std::map<std::thread::id, ThreadKernels *>::iterator it = threads_.begin();
+         it != threads_.end(); ++it) {
+        delete it->second;
+    }
+}
+
+bool KernelRegistry::init(const Program& program, const Device& device)
+{
+    std::vector<Kernel> kernels;
+
+    /* one call for all of them, no lookup by name */
+    program_ = program;
+    cl_int error_number = program_.createKernels(&kernels);
+
+    if (error_number != CL_SUCCESS) {
+        CL_WARN("create kernels fail: " + ErrorNumberToString(error_number) + " ");
+        return (false);
+    }
+
+    use_clone_ = SupportsCloneKernel(device);
+
+    for (size_t i = 0; i < kernels.size(); i++) {
+        std::string name;
+        KernelInfo  info;
+
+        error_number = kernels[i].getInfo(CL_KERNEL_FUNCTION_NAME, &name);
+
+        if (error_number == CL_SUCCESS) {
+            error_number = kernels[i].getWorkGroupInfo(device, CL_KERNEL_WORK_GROUP_SIZE,
+                                                       &info.work_group_size);
+        }
+
+        if (error_number == CL_SUCCESS) {
+            error_number = kernels[i].getWorkGroupInfo(device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+                                                       &info.preferred_multiple);
+        }
+
+        if (error_number == CL_SUCCESS) {
+            error_number = kernels[i].getWorkGroupInfo(device, CL_KERNEL_LOCAL_MEM_SIZE,
+                                                       &info.local_mem_size);
+        }
+
+        if (error_number == CL_SUCCESS) {
+            error_number = kernels[i].getWorkGroupInfo(device, CL_KERNEL_PRIVATE_MEM_SIZE,
+                                                       &info.private_mem_size);
+        }
+
+        if (error_number != CL_SUCCESS) {
+            CL_WARN("get kernel info fail: " + ErrorNumberToString(error_number) + " ");
+            return (false);
+        }
+
+        /* some drivers pad the name with its terminator */
+        name.resize(strlen(name.c_str()));
+
+        names_.push_back(name);
+        prototypes_.push_back(kernels[i]);
+        infos_.push_back(info);
+    }
+
+    return (true);
+}
+
+int KernelRegistry::lookup(const std::string& name) const
+{
+    for (size_t i = 0; i < names_.size(); i++) {
+        if (names_[i] == name) {
+            return (int)i;
+        }
+    }
+
+    return (-1);
+}
+
+KernelRegistry::ThreadKernels *KernelRegistry::thread_kernels()
+{
+    KernelThreadCache& cache = thread_cache;
+
+    for (int i = 0; i < KERNEL_THREAD_CACHE; i++) {
+        if (cache.entries[i].registry_id == id_) {
+            return (ThreadKernels *)cache.entries[i].kernels;
+        }
+    }
+
+    ThreadKernels *kernels;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ThreadKernels *& slot = threads_[std::this_thread::get_id()];
+
+        if (slot == NULL) {
+            slot = new ThreadKernels();
+            slot->kernels.resize(prototypes_.size());
+        }
+        kernels = slot;
+    }
+
+    /* ids are never reused, so entries of destroyed registries never match */
+    KernelThreadCache::Entry& entry = cache.entries[cache.next++ % KERNEL_THREAD_CACHE];
+    entry.registry_id = id_;
+    entry.kernels     = kernels;
+
+    return (kernels);
+}
+
+cl::Kernel *KernelRegistry::kernel(int handle)
+{
+    if ((handle < 0) || ((size_t)handle >= prototypes_.size())) {
+        return (NULL);
+    }
+
+    Kernel& kernel = thread_kernels()->kernels[handle];
+
+    if (kernel() != NULL) {
+        return (&kernel);
+    }
+
+    cl_int error_number = CL_SUCCESS;
+
+#ifdef CL_VERSION_2_1
+    if (use_clone_) {
+        cl_kernel clone = clCloneKernel(prototypes_[handle](), &error_number);
+
+        if (error_number == CL_SUCCESS) {
+            kernel() = clone;
+        }
+    } else
+#endif
+    {
+        kernel = Kernel(program_, names_[handle].c_str(), &error_number);
+    }
+
+    if (error_number != CL_SUCCESS) {
+        CL_WARN("create kernel " + names_[handle] + " fail: " + ErrorNumberToString(error_number) + " ");
+        return (NULL);
+    }
+
+    return (&kernel);
+}
+
+cl::Kernel *KernelRegistry::prototype(int handle)
+{
+    if ((handle < 0) || ((size_t)handle >= prototypes_.size())) {
+        return (NULL);
+    }
+
+    return (&prototypes_[handle]);
+}
+
+const KernelInfo *KernelRegistry::info(int handle) const
+{
+    if ((handle < 0) || ((size_t)handle >= infos_.size())) {
+        return (NULL);
+    }
+
+    return (&infos_[handle]);
+}
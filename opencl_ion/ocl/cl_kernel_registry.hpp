@@ -0,0 +1,106 @@
+#ifndef _OPENCL_CL_KERNEL_REGISTRY_H_
+#define _OPENCL_CL_KERNEL_REGISTRY_H_
+
+#if !(defined(__APPLE__) || defined(__MACOSX))
+#include "CL/cl.hpp"
+#else
+#include "cl.hpp"
+#endif
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* clGetKernelWorkGroupInfo results, queried once per kernel */
+struct KernelInfo {
+    size_t   work_group_size;    // CL_KERNEL_WORK_GROUP_SIZE
+    size_t   preferred_multiple; // CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
+    cl_ulong local_mem_size;     // CL_KERNEL_LOCAL_MEM_SIZE
+    cl_ulong private_mem_size;   // CL_KERNEL_PRIVATE_MEM_SIZE
+};
+
+/**
+ * every kernel of a program, created once instead of one cl::Kernel (a
+ * driver lookup by name) per launch.
+ *
+ * setArg on one cl::Kernel is not thread safe, so each thread gets its own
+ * instance of each kernel: a clCloneKernel() of the prototype on opencl
+ * 2.1 devices, which also copies the arguments already set on it, a fresh
+ * clCreateKernel otherwise. resolve names to handles once with lookup(),
+ * kernel(handle) is then an array index on the calling thread.
+ *
+ * per-thread instances live until the registry is destroyed.
+ */
+class KernelRegistry {
+public:
+    KernelRegistry();
+    ~KernelRegistry();
+
+    /**
+     * create the prototype of every kernel in the program and query its
+     * work-group info
+     * @param  program [built program]
+     * @param  device  [device the kernels are launched on]
+     * @return         [true for success]
+     */
+    bool init(const cl::Program& program, const cl::Device& device);
+
+    /**
+     * @param  name [kernel function name]
+     * @return      [handle for kernel()/info()/prototype(), -1 if unknown]
+     */
+    int lookup(const std::string& name) const;
+
+    /**
+     * kernel instance owned by the calling thread, created on its first use
+     * @param  handle [from lookup()]
+     * @return        [kernel, NULL if the handle is invalid or creation failed]
+     */
+    cl::Kernel *kernel(int handle);
+
+    /**
+     * shared prototype; arguments set here before a thread's first kernel()
+     * are inherited by clones. not for concurrent setArg
+     * @param  handle [from lookup()]
+     * @return        [kernel, NULL if the handle is invalid]
+     */
+    cl::Kernel *prototype(int handle);
+
+    /**
+     * @param  handle [from lookup()]
+     * @return        [cached work-group info, NULL if the handle is invalid]
+     */
+    const KernelInfo *info(int handle) const;
+
+    size_t count() const { return names_.size(); }
+
+    /**
+     * @return [true if per-thread kernels are clCloneKernel() copies]
+     */
+    bool uses_clone() const { return use_clone_; }
+
+private:
+    KernelRegistry(const KernelRegistry&) = delete;
+    KernelRegistry& operator=(const KernelRegistry&) = delete;
+
+    struct ThreadKernels {
+        std::vector<cl::Kernel> kernels; // empty cl::Kernel until first use
+    };
+
+    ThreadKernels *thread_kernels();
+
+    unsigned long id_;                  // never reused, tags the thread-local cache
+    cl::Program program_;
+    bool use_clone_;
+    std::vector<std::string> names_;    // by handle
+    std::vector<cl::Kernel> prototypes_;
+    std::vector<KernelInfo> infos_;
+
+    std::mutex mutex_;                  // threads_, taken once per thread
+    std::map<std::thread::id, ThreadKernels *> threads_;
+};
+
+#endif // ifndef _OPENCL_CL_KERNEL_REGISTRY_H_
@@ -0,0 +1,478 @@
+#include "cl_program_cache.hpp"
+#include "cl_common.hpp"
+#include "cl_wrapper.hpp"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+
+using namespace std;
+using namespace cl;
+
+#define PROGRAM_CACHE_MAGIC   0x42504c43 // "CLPB"
+#define PROGRAM_CACHE_VERSION 1
+#define PROGRAM_CACHE_SUFFIX  ".clbin"
+#define PROGRAM_CACHE_TMP_AGE 600 // seconds before a temporary file counts as stale
+
+/*
+ * file layout: ProgramCacheHeader, then per device a ProgramCacheEntry
+ * followed by its binary, in the device order of the key
+ */
+struct ProgramCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t device_count;
+    uint32_t reserved;
+};
+
+struct ProgramCacheEntry {
+    uint64_t size;
+    uint64_t hash;
+};
+
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint64_t hash = seed;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return (hash);
+}
+
+uint64_t HashSources(const std::vector<std::string>& sources)
+{
+    uint64_t hash = PROGRAM_CACHE_HASH_SEED;
+
+    for (size_t i = 0; i < sources.size(); i++) {
+        uint64_t source_hash = HashBytes(sources[i].data(), sources[i].size());
+
+        hash = HashBytes(&source_hash, sizeof(source_hash), hash);
+    }
+
+    return (hash);
+}
+
+uint64_t HashSources(const std::vector<ClSourceBlob>& blobs)
+{
+    uint64_t hash = PROGRAM_CACHE_HASH_SEED;
+
+    for (size_t i = 0; i < blobs.size(); i++) {
+        hash = HashBytes(&blobs[i].hash, sizeof(blobs[i].hash), hash);
+    }
+
+    return (hash);
+}
+
+static uint64_t HashString(const std::string& text, uint64_t seed)
+{
+    /* the terminator separates neighbouring strings */
+    return (HashBytes(text.c_str(), text.size() + 1, seed));
+}
+
+static bool MakeDirectories(const std::string& directory)
+{
+    for (size_t pos = 1; pos <= directory.size(); pos++) {
+        if ((pos != directory.size()) && (directory[pos] != '/')) {
+            continue;
+        }
+
+        std::string prefix = directory.substr(0, pos);
+
+        if ((mkdir(prefix.c_str(), 0755) < 0) && (errno != EEXIST)) {
+            return (false);
+        }
+    }
+
+    return (true);
+}
+
+static bool WriteAll(int fd, const void *data, size_t size)
+{
+    const char *bytes = (const char *)data;
+
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (false);
+        }
+        bytes += written;
+        size  -= written;
+    }
+
+    return (true);
+}
+
+static bool ReadFile(const std::string& path, uint64_t max_bytes, std::vector<char>& data)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return (false);
+    }
+
+    struct stat st;
+
+    if ((fstat(fd, &st) < 0) || ((uint64_t)st.st_size > max_bytes)) {
+        close(fd);
+        return (false);
+    }
+
+    data.resize(st.st_size);
+
+    size_t done = 0;
+
+    while (done < data.size()) {
+        ssize_t got = read(fd, &data[done], data.size() - done);
+
+        if ((got < 0) && (errno == EINTR)) {
+            continue;
+        }
+
+        if (got <= 0) {
+            break;
+        }
+        done += got;
+    }
+    close(fd);
+
+    return (done == data.size());
+}
+
+ProgramCache::ProgramCache(const std::string& directory, uint64_t max_bytes)
+    : directory_(directory), max_bytes_(max_bytes), hits_(0), misses_(0)
+{
+    while ((directory_.size() > 1) && (directory_[directory_.size() - 1] == '/')) {
+        directory_.erase(directory_.size() - 1);
+    }
+
+    if (!directory_.empty() && !MakeDirectories(directory_)) {
+        CL_WARN("program cache disabled, cannot create " + directory_ + ": " + strerror(errno) + " ");
+        directory_.clear();
+    }
+}
+
+std::string ProgramCache::DefaultDirectory()
+{
+    const char *directory = getenv("OPENCL_PROGRAM_CACHE");
+
+    if (directory != NULL) {
+        return (directory);
+    }
+
+    const char *home = getenv("HOME");
+
+    if ((home != NULL) && (home[0] != '\0')) {
+        return (std::string(home) + "/.cache/opencl_ion");
+    }
+
+    return ("/data/local/tmp/opencl_ion");
+}
+
+uint64_t ProgramCache::key(uint64_t                       source_hash,
+                           const std::string            & options,
+                           const std::vector<cl::Device>& devices) const
+{
+    uint32_t version = PROGRAM_CACHE_VERSION;
+    uint64_t hash    = HashBytes(&version, sizeof(version));
+
+    hash = HashBytes(&source_hash, sizeof(source_hash), hash);
+    hash = HashString(options, hash);
+
+    for (size_t i = 0; i < devices.size(); i++) {
+        std::string    name, device_version, driver_version, platform_version;
+        cl_platform_id platform_id = NULL;
+
+        devices[i].getInfo(CL_DEVICE_NAME, &name);
+        devices[i].getInfo(CL_DEVICE_VERSION, &device_version);
+        devices[i].getInfo(CL_DRIVER_VERSION, &driver_version);
+        devices[i].getInfo(CL_DEVICE_PLATFORM, &platform_id);
+
+        Platform platform;
+        platform() = platform_id;
+        platform.getInfo(CL_PLATFORM_VERSION, &platform_version);
+
+        hash = HashString(name, hash);
+        hash = HashString(device_version, hash);
+        hash = HashString(driver_version, hash);
+        hash = HashString(platform_version, hash);
+    }
+
+    return (hash);
+}
+
+std::string ProgramCache::path(uint64_t key) const
+{
+    char name[32];
+
+    snprintf(name, sizeof(name), "/%016llx" PROGRAM_CACHE_SUFFIX, (unsigned long long)key);
+
+    return (directory_ + name);
+}
+
+bool ProgramCache::load(Context                        context,
+                        const std::vector<cl::Device>& devices,
+                        uint64_t                       key,
+                        const std::string            & options,
+                        Program                      & program)
+{
+    if (!is_enabled()) {
+        return (false);
+    }
+
+    std::string       file = path(key);
+    std::vector<char> data;
+
+    if (!ReadFile(file, max_bytes_, data)) {
+        misses_++;
+        return (false);
+    }
+
+    /* validate everything before the driver sees it */
+    ProgramCacheHeader header;
+    Program::Binaries  binaries;
+    size_t offset = sizeof(header);
+    bool   valid  = (data.size() >= sizeof(header));
+
+    if (valid) {
+        memcpy(&header, &data[0], sizeof(header));
+        valid = (header.magic == PROGRAM_CACHE_MAGIC) &&
+                (header.version == PROGRAM_CACHE_VERSION) &&
+                (header.key == key) &&
+                (header.device_count == devices.size());
+    }
+
+    for (size_t i = 0; valid && (i < devices.size()); i++) {
+        ProgramCacheEntry entry;
+
+        if (data.size() - offset < sizeof(entry)) {
+            valid = false;
+            break;
+        }
+        memcpy(&entry, &data[offset], sizeof(entry));
+        offset += sizeof(entry);
+
+        if ((entry.size == 0) || (entry.size > data.size() - offset) ||
+            (HashBytes(&data[offset], entry.size) != entry.hash)) {
+            valid = false;
+            break;
+        }
+        binaries.push_back(std::make_pair((const void *)&data[offset], (size_t)entry.size));
+        offset += entry.size;
+    }
+
+    if (!valid || (offset != data.size())) {
+        CL_WARN("corrupt program cache entry " + file + ", rebuilding ");
+        unlink(file.c_str());
+        misses_++;
+        return (false);
+    }
+
+    cl_int error_number = 0;
+    std::vector<cl_int> binary_status;
+    Program cached(context, devices, binaries, &binary_status, &error_number);
+
+    if (error_number == CL_SUCCESS) {
+        /* binaries still have to be built, which only links them */
+        error_number = cached.build(devices, options.c_str());
+    }
+
+    if (error_number != CL_SUCCESS) {
+        /* e.g. CL_INVALID_BINARY after a driver update the key missed */
+        CL_WARN("program cache entry " + file + " rejected: " + ErrorNumberToString(error_number) + ", rebuilding ");
+        unlink(file.c_str());
+        misses_++;
+        return (false);
+    }
+
+    /* a hit refreshes the file for the lru eviction */
+    utimensat(AT_FDCWD, file.c_str(), NULL, 0);
+
+    program = cached;
+    hits_++;
+
+    return (true);
+}
+
+bool ProgramCache::store(const Program                & program,
+                         const std::vector<cl::Device>& devices,
+                         uint64_t                       key)
+{
+    if (!is_enabled()) {
+        return (false);
+    }
+
+    /* binaries come in CL_PROGRAM_DEVICES order, which holds every device of
+       the context, not only the ones built for */
+    cl_int error_number = 0;
+    std::vector<Device> program_devices = program.getInfo<CL_PROGRAM_DEVICES>(&error_number);
+    std::vector<size_t> sizes = program.getInfo<CL_PROGRAM_BINARY_SIZES>(&error_number);
+
+    if ((error_number != CL_SUCCESS) || (sizes.size() != program_devices.size())) {
+        CL_WARN("get program binary sizes fail ");
+        return (false);
+    }
+
+    std::vector<std::vector<unsigned char> > storage(sizes.size());
+    std::vector<unsigned char *> pointers(sizes.size());
+
+    for (size_t i = 0; i < sizes.size(); i++) {
+        storage[i].resize(sizes[i] + 1);
+        pointers[i] = &storage[i][0];
+    }
+
+    error_number = clGetProgramInfo(program(), CL_PROGRAM_BINARIES,
+                                    pointers.size() * sizeof(unsigned char *),
+                                    &pointers[0], NULL);
+
+    if (error_number != CL_SUCCESS) {
+        CL_WARN("get program binaries fail: " + ErrorNumberToString(error_number) + " ");
+        return (false);
+    }
+
+    std::vector<size_t> order;
+
+    for (size_t i = 0; i < devices.size(); i++) {
+        size_t index = 0;
+
+        while ((index < program_devices.size()) && (program_devices[index]() != devices[i]())) {
+            index++;
+        }
+
+        if ((index == program_devices.size()) || (sizes[index] == 0)) {
+            CL_WARN("program has no binary for a device, not cached ");
+            return (false);
+        }
+        order.push_back(index);
+    }
+
+    char tmp_name[64];
+    snprintf(tmp_name, sizeof(tmp_name), "/.%016llx.XXXXXX.tmp", (unsigned long long)key);
+
+    /* a unique name per writer, threads of one process included; evict()
+       removes the ones a crashed writer left behind */
+    std::vector<char> tmp_path(directory_.begin(), directory_.end());
+    tmp_path.insert(tmp_path.end(), tmp_name, tmp_name + strlen(tmp_name) + 1);
+
+    std::string file = path(key);
+    int fd = mkostemps(&tmp_path[0], strlen(".tmp"), O_CLOEXEC);
+    std::string tmp = &tmp_path[0];
+
+    if (fd < 0) {
+        CL_WARN("cannot write " + tmp + ": " + strerror(errno) + " ");
+        return (false);
+    }
+
+    /* mkostemps() creates 0600, entries are shared like before */
+    fchmod(fd, 0644);
+
+    ProgramCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic        = PROGRAM_CACHE_MAGIC;
+    header.version      = PROGRAM_CACHE_VERSION;
+    header.key          = key;
+    header.device_count = devices.size();
+
+    bool written = WriteAll(fd, &header, sizeof(header));
+
+    for (size_t i = 0; written && (i < order.size()); i++) {
+        ProgramCacheEntry entry;
+        entry.size = sizes[order[i]];
+        entry.hash = HashBytes(pointers[order[i]], entry.size);
+
+        written = WriteAll(fd, &entry, sizeof(entry)) &&
+                  WriteAll(fd, pointers[order[i]], entry.size);
+    }
+
+    /* the data must be on disk before the rename publishes it */
+    written = written && (fsync(fd) == 0);
+
+    if ((close(fd) < 0) || !written || (rename(tmp.c_str(), file.c_str()) < 0)) {
+        CL_WARN("cannot write " + file + ": " + strerror(errno) + " ");
+        unlink(tmp.c_str());
+        return (false);
+    }
+
+    evict();
+
+    return (true);
+}
+
+struct CacheFile {
+    std::string path;
+    uint64_t    size;
+    time_t      mtime;
+
+    bool operator<(const CacheFile& other) const { return mtime < other.mtime; }
+};
+
+void ProgramCache::evict()
+{
+    if (!is_enabled()) {
+        return;
+    }
+
+    DIR *dir = opendir(directory_.c_str());
+
+    if (dir == NULL) {
+        return;
+    }
+
+    std::vector<CacheFile> files;
+    uint64_t total = 0;
+    time_t   now   = time(NULL);
+    struct dirent *ent;
+
+    while ((ent = readdir(dir)) != NULL) {
+        std::string name = ent->d_name;
+        std::string file = directory_ + "/" + name;
+        struct stat st;
+
+        if (stat(file.c_str(), &st) < 0) {
+            continue;
+        }
+
+        /* .<key>.XXXXXX.tmp from store() */
+        bool is_tmp   = (name.size() > 4) && (name[0] == '.') &&
+                        (name.compare(name.size() - 4, 4, ".tmp") == 0);
+        bool is_entry = (name.size() > strlen(PROGRAM_CACHE_SUFFIX)) &&
+                        (name.compare(name.size() - strlen(PROGRAM_CACHE_SUFFIX),
+                                      strlen(PROGRAM_CACHE_SUFFIX), PROGRAM_CACHE_SUFFIX) == 0);
+
+        if (is_tmp && (now - st.st_mtime > PROGRAM_CACHE_TMP_AGE)) {
+            unlink(file.c_str());
+        } else if (is_entry) {
+            CacheFile entry = { file, (uint64_t)st.st_size, st.st_mtime };
+            files.push_back(entry);
+            total += st.st_size;
+        }
+    }
+    closedir(dir);
+
+    if (total <= max_bytes_) {
+        return;
+    }
+
+    std::sort(files.begin(), files.end());
+
+    for (size_t i = 0; (i < files.size()) && (total > max_bytes_); i++) {
+        /* another process may have evicted it already */
+        unlink(files[i].path.c_str());
+        total -= files[i].size;
+    }
+}
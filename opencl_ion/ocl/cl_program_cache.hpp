@@ -0,0 +1,132 @@
+#ifndef _OPENCL_CL_PROGRAM_CACHE_H_
+#define _OPENCL_CL_PROGRAM_CACHE_H_
+
+#if !(defined(__APPLE__) || defined(__MACOSX))
+#include "CL/cl.hpp"
+#else
+#include "cl.hpp"
+#endif
+
+#include "cl_source_blob.hpp"
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#define PROGRAM_CACHE_MAX_BYTES (64ULL * 1024 * 1024) // default size bound
+#define PROGRAM_CACHE_HASH_SEED 0xcbf29ce484222325ULL // fnv-1a 64 offset basis
+
+/**
+ * fnv-1a 64 hash, chainable through seed
+ * @param  data [bytes]
+ * @param  size [byte count]
+ * @param  seed [previous hash, PROGRAM_CACHE_HASH_SEED to start]
+ * @return      [hash]
+ */
+uint64_t HashBytes(const void *data, size_t size,
+                   uint64_t seed = PROGRAM_CACHE_HASH_SEED);
+
+/**
+ * hash of program sources, in order; chains the HashBytes() of each text
+ * @param  sources [source texts]
+ * @return         [hash]
+ */
+uint64_t HashSources(const std::vector<std::string>& sources);
+
+/**
+ * same hash as for the texts of the blobs, from their precomputed hashes
+ * @param  blobs [embedded sources]
+ * @return       [hash]
+ */
+uint64_t HashSources(const std::vector<ClSourceBlob>& blobs);
+
+/**
+ * on-disk cache of built program binaries (CL_PROGRAM_BINARIES), one file
+ * per program keyed by the sources, the build options and the device,
+ * driver and platform versions, so a driver update rebuilds by itself.
+ *
+ * files are written to a temporary name and renamed into place, carry a
+ * checksum per binary, and are deleted when they fail to load or build.
+ * the oldest used files are evicted once the directory exceeds max_bytes.
+ * any number of threads and processes may share a directory.
+ */
+class ProgramCache {
+public:
+    /**
+     * @param  directory [cache directory, created if missing; empty disables
+     *                    the cache]
+     * @param  max_bytes [size bound of the directory]
+     */
+    explicit ProgramCache(const std::string& directory = DefaultDirectory(),
+                          uint64_t           max_bytes = PROGRAM_CACHE_MAX_BYTES);
+
+    /**
+     * @return [$OPENCL_PROGRAM_CACHE, else $HOME/.cache/opencl_ion, else
+     *          /data/local/tmp/opencl_ion]
+     */
+    static std::string DefaultDirectory();
+
+    /**
+     * @param  source_hash [HashSources() of the program]
+     * @param  options     [build options]
+     * @param  devices     [devices the program is built for]
+     * @return             [cache key]
+     */
+    uint64_t key(uint64_t                       source_hash,
+                 const std::string&             options,
+                 const std::vector<cl::Device>& devices) const;
+
+    /**
+     * create and build a program from cached binaries
+     * @param  context [opencl context]
+     * @param  devices [devices, in the order used for key()]
+     * @param  key     [cache key]
+     * @param  options [build options]
+     * @param  program [return program]
+     * @return         [true for a hit, false for a miss or a bad entry]
+     */
+    bool load(cl::Context                    context,
+              const std::vector<cl::Device>& devices,
+              uint64_t                       key,
+              const std::string&             options,
+              cl::Program                  & program);
+
+    /**
+     * save the binaries of a built program, then evict down to max_bytes
+     * @param  program [built program]
+     * @param  devices [devices, in the order used for key()]
+     * @param  key     [cache key]
+     * @return         [true if written]
+     */
+    bool store(const cl::Program            & program,
+               const std::vector<cl::Device>& devices,
+               uint64_t                       key);
+
+    /**
+     * delete the least recently used files until the directory fits
+     * max_bytes, and temporary files left by crashed writers
+     */
+    void evict();
+
+    bool is_enabled() const { return !directory_.empty(); }
+
+    const std::string& directory() const { return directory_; }
+
+    unsigned int hits() const { return hits_.load(); }
+
+    unsigned int misses() const { return misses_.load(); }
+
+private:
+    ProgramCache(const ProgramCache&) = delete;
+    ProgramCache& operator=(const ProgramCache&) = delete;
+
+    std::string path(uint64_t key) const;
+
+    std::string directory_;
+    uint64_t max_bytes_;
+    std::atomic<unsigned int> hits_;
+    std::atomic<unsigned int> misses_;
+};
+
+#endif // ifndef _OPENCL_CL_PROGRAM_CACHE_H_
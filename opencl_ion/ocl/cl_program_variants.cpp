@@ -0,0 +1,148 @@
+#include "cl_program_variants.hpp"
+#include "cl_program_cache.hpp"
+#include "cl_wrapper.hpp"
+
+using namespace std;
+using namespace cl;
+
+std::string BuildPresetOptions(unsigned int presets)
+{
+    static const struct {
+        BuildPreset preset;
+        const char *option;
+    } preset_options[] = {
+        { BUILD_PRESET_FAST_RELAXED_MATH, "-cl-fast-relaxed-math" },
+        { BUILD_PRESET_MAD_ENABLE,        "-cl-mad-enable"        },
+        { BUILD_PRESET_NO_SIGNED_ZEROS,   "-cl-no-signed-zeros"   },
+    };
+
+    std::string options;
+
+    for (size_t i = 0; i < sizeof(preset_options) / sizeof(preset_options[0]); i++) {
+        if (presets & preset_options[i].preset) {
+            if (!options.empty()) {
+                options += " ";
+            }
+            options += preset_options[i].option;
+        }
+    }
+
+    return (options);
+}
+
+std::string SpecializationOptions(const SpecializationConstants& constants,
+                                  unsigned int                   presets)
+{
+    std::string options = BuildPresetOptions(presets);
+
+    for (SpecializationConstants::const_iterator it = constants.begin();
+         it != constants.end(); ++it) {
+        if (!options.empty()) {
+            options += " ";
+        }
+        options += "-D " + it->first + "=" + it->second;
+    }
+
+    return (options);
+}
+
+ProgramVariants::ProgramVariants(Context                         context,
+                                 const std::vector<Device>     & devices,
+                                 const std::vector<std::string>& sources,
+                                 ProgramCache                   *cache)
+    : context_(context),
+    devices_(devices),
+    sources_(sources),
+    source_hash_(HashSources(sources)),
+    cache_(cache)
+{}
+
+ProgramVariants::~ProgramVariants()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    /* background builds write into the variants; a deferred build that no
+       get() started must not run now */
+    for (std::map<std::string, std::unique_ptr<Variant> >::iterator it = variants_.begin();
+         it != variants_.end(); ++it) {
+        if (it->second->built.wait_for(std::chrono::seconds(0)) != std::future_status::deferred) {
+            it->second->built.wait();
+        }
+    }
+}
+
+bool ProgramVariants::build(const std::string& options, Program& program)
+{
+    uint64_t key = 0;
+
+    if (cache_ != NULL) {
+        key = cache_->key(source_hash_, options, devices_);
+
+        if (cache_->load(context_, devices_, key, options, program)) {
+            return (true);
+        }
+    }
+
+    if (!BuildProgram(context_, devices_, sources_, options, program)) {
+        CL_WARN("Failed to build variant \"" + options + "\" ");
+        return (false);
+    }
+
+    if (cache_ != NULL) {
+        cache_->store(program, devices_, key);
+    }
+
+    return (true);
+}
+
+ProgramVariants::Variant *ProgramVariants::find_or_add(const std::string       & options,
+                                                       std::launch               policy,
+                                                       std::shared_future<bool>& built)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<Variant>  & variant = variants_[options];
+
+    if (!variant) {
+        /* deferred: the first get() builds it, concurrent ones wait for it */
+        variant.reset(new Variant());
+        Program *program = &variant->program;
+        variant->built = std::async(policy, [this, options, program]() {
+            return (build(options, *program));
+        }).share();
+    }
+    built = variant->built;
+
+    return (variant.get());
+}
+
+bool ProgramVariants::get(const SpecializationConstants& constants,
+                          unsigned int                   presets,
+                          Program                      & program)
+{
+    std::shared_future<bool> built;
+    Variant *variant = find_or_add(SpecializationOptions(constants, presets),
+                                   std::launch::deferred, built);
+
+    if (!built.get()) {
+        return (false);
+    }
+
+    program = variant->program;
+
+    return (true);
+}
+
+void ProgramVariants::prefetch(const SpecializationConstants& constants,
+                               unsigned int                   presets)
+{
+    std::shared_future<bool> built;
+
+    find_or_add(SpecializationOptions(constants, presets), std::launch::async, built);
+}
+
+size_t ProgramVariants::size()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return (variants_.size());
+}
@@ -0,0 +1,130 @@
+#ifndef _OPENCL_CL_PROGRAM_VARIANTS_H_
+#define _OPENCL_CL_PROGRAM_VARIANTS_H_
+
+#if !(defined(__APPLE__) || defined(__MACOSX))
+#include "CL/cl.hpp"
+#else
+#include "cl.hpp"
+#endif
+
+#include <stdint.h>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ProgramCache;
+
+/* named build option sets, combinable */
+enum BuildPreset {
+    BUILD_PRESET_NONE              = 0,
+    BUILD_PRESET_FAST_RELAXED_MATH = 1 << 0, // -cl-fast-relaxed-math
+    BUILD_PRESET_MAD_ENABLE        = 1 << 1, // -cl-mad-enable
+    BUILD_PRESET_NO_SIGNED_ZEROS   = 1 << 2, // -cl-no-signed-zeros
+    BUILD_PRESET_FAST              = BUILD_PRESET_FAST_RELAXED_MATH | BUILD_PRESET_MAD_ENABLE,
+};
+
+/* -D name=value per entry, e.g. { "WIDTH", "1920" } */
+typedef std::map<std::string, std::string> SpecializationConstants;
+
+/**
+ * @param  presets [BuildPreset bits]
+ * @return         [option string, e.g. "-cl-fast-relaxed-math -cl-mad-enable"]
+ */
+std::string BuildPresetOptions(unsigned int presets);
+
+/**
+ * [build options of one variant: the presets, then -D for every constant in
+ *  name order, so equal values always give equal strings]
+ * @param  constants [specialization constants]
+ * @param  presets   [BuildPreset bits]
+ * @return           [option string]
+ */
+std::string SpecializationOptions(const SpecializationConstants& constants,
+                                  unsigned int                   presets);
+
+/**
+ * specialized builds of one program source: kernels read geometry such as
+ * width, height, stride and channel count from -D constants instead of
+ * arguments, so the compiler can unroll and vectorize for them.
+ *
+ * variants are built once per distinct set of constants and presets and
+ * kept in memory; with a ProgramCache they also survive restarts. get()
+ * builds a missing variant on the calling thread, prefetch() in the
+ * background. a failed build is remembered and not retried.
+ *
+ * any number of threads may call get()/prefetch() concurrently.
+ */
+class ProgramVariants {
+public:
+    /**
+     * @param  context [opencl context]
+     * @param  devices [devices to build for]
+     * @param  sources [program source texts]
+     * @param  cache   [binary cache, NULL keeps variants in memory only;
+     *                  must outlive this object]
+     */
+    ProgramVariants(cl::Context                     context,
+                    const std::vector<cl::Device>&  devices,
+                    const std::vector<std::string>& sources,
+                    ProgramCache                   *cache = NULL);
+
+    /**
+     * waits for background builds
+     */
+    ~ProgramVariants();
+
+    /**
+     * @param  constants [specialization constants]
+     * @param  presets   [BuildPreset bits]
+     * @param  program   [return program]
+     * @return           [true if the variant is built]
+     */
+    bool get(const SpecializationConstants& constants,
+             unsigned int                   presets,
+             cl::Program                  & program);
+
+    /**
+     * start building a variant on a background thread, e.g. for the next
+     * resolution, so a later get() does not wait
+     * @param  constants [specialization constants]
+     * @param  presets   [BuildPreset bits]
+     */
+    void prefetch(const SpecializationConstants& constants,
+                  unsigned int                   presets);
+
+    /**
+     * @return [variants built or being built]
+     */
+    size_t size();
+
+private:
+    ProgramVariants(const ProgramVariants&) = delete;
+    ProgramVariants& operator=(const ProgramVariants&) = delete;
+
+    struct Variant {
+        cl::Program              program;
+        std::shared_future<bool> built;
+    };
+
+    /* built is a copy taken under mutex_: one shared_future object must
+       not be used by several threads at once, copies of it may */
+    Variant *find_or_add(const std::string       & options,
+                         std::launch               policy,
+                         std::shared_future<bool>& built);
+
+    bool build(const std::string& options, cl::Program& program);
+
+    cl::Context context_;
+    std::vector<cl::Device> devices_;
+    std::vector<std::string> sources_;
+    uint64_t source_hash_;
+    ProgramCache *cache_;
+
+    std::mutex mutex_; // variants_ only, builds run unlocked
+    std::map<std::string, std::unique_ptr<Variant> > variants_;
+};
+
+#endif // ifndef _OPENCL_CL_PROGRAM_VARIANTS_H_
@@ -0,0 +1,19 @@
+#ifndef _OPENCL_CL_SOURCE_BLOB_H_
+#define _OPENCL_CL_SOURCE_BLOB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * program source compiled into the binary by tools/embed_cl, see the
+ * generated gen/cl_sources.hpp. all members are constants, so blobs are
+ * usable in constant expressions and cost no file i/o or copies.
+ */
+struct ClSourceBlob {
+    const char *name; // file name under cl/
+    const char *text; // nul terminated source
+    size_t      size; // bytes, without the terminator
+    uint64_t    hash; // HashBytes(text, size), see cl_program_cache.hpp
+};
+
+#endif // ifndef _OPENCL_CL_SOURCE_BLOB_H_
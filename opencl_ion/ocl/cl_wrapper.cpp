@@ -1,7 +1,12 @@
 #include "cl_wrapper.hpp"
+#include "cl_program_cache.hpp"
+#include "cl_device_select.hpp"
+#include <stdio.h>
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <functional>
+#include <iterator>
 #include <vector>
 
 using namespace std;
@@ -50,27 +55,10 @@ bool PrintProfilingInfo(std::string info, Event event)
 
 bool CreateContext(Context& context)
 {
-    cl_int error_number = 0;
-
-    std::vector<Platform> platforms;
-
-    /* Retrieve a single platform ID. */
-    error_number = Platform::get(&platforms);
-
-    if (error_number < 0) {
-        CL_WARN("No OpenCL platforms found. ");
-        return (false);
-    }
-
-    cout << "platforms count :" << platforms.size() << endl;
-
-    /* Get a context with a GPU device from the platform found above. */
-
-    // cl_context_properties context_properties[] =
-    // { CL_CONTEXT_PLATFORM, (cl_context_properties)platforms.front(), 0 };
-    context = Context((cl_device_type)CL_DEVICE_TYPE_GPU, NULL, NULL, NULL, &error_number);
+    std::vector<RankedDevice> ranked;
 
-    return (error_number);
+    /* the best device of any platform, see cl_device_select.hpp */
+    return (CreateContext(context, ranked, 1));
 }
 
 bool GetDeivces(Context context, std::vector<Device>& devices)
@@ -105,15 +93,12 @@ bool CreateCommandQueue(Context context, CommandQueue& command_queue, Device dev
     return (true);
 }
 
-bool CreateProgram(Context                 context,
-                   std::vector<Device>   & devices,
-                   std::vector<std::string>filenames,
-                   Program               & program)
+bool ReadProgramSources(const std::vector<std::string>& filenames,
+                        std::vector<std::string>      & sources)
 {
-    cl_int error_number = 0;
-    Program::Sources source;
+    sources.clear();
 
-    for (int i = 0; i < filenames.size(); i++) {
+    for (size_t i = 0; i < filenames.size(); i++) {
         ifstream kernel_file(filenames[i].c_str(), ios::in);
 
         if (!kernel_file.is_open()) {
@@ -121,29 +106,23 @@ bool CreateProgram(Context                 context,
             return (false);
         }
 
-        /*
-         * Read the kernel file into an output stream.
-         * Convert this into a char array for passing to OpenCL.
-         */
+        /* Read the kernel file into an output stream. */
         ostringstream output_string_stream;
         output_string_stream << kernel_file.rdbuf();
-        std::string *src_std_str = new std::string(output_string_stream.str());
-        const char *char_source = (*src_std_str).c_str();
-
-        source.push_back(std::make_pair(char_source, strlen(char_source)));
+        sources.push_back(output_string_stream.str());
     }
 
-    program = Program(context, source, &error_number);
-
-    if (error_number < 0) {
-        cerr << "Failed to create OpenCL program. " << __FILE__ << ":" << __LINE__ << endl;
-        return (false);
-    }
+    return (true);
+}
 
+static bool BuildCreatedProgram(std::vector<Device>& devices,
+                                const std::string  & options,
+                                Program            & program)
+{
     /* Try to build the OpenCL program. */
 
     // char   build_para[128] = "-cl-opt-disable";
-    cl_int build_success = program.build(devices);
+    cl_int build_success = program.build(devices, options.empty() ? NULL : options.c_str());
 
     /*
      * If the build succeeds with no log, an empty string is returned (logSize =
@@ -151,7 +130,7 @@ bool CreateProgram(Context                 context,
      * we only want to print the message if it has some content (logSize > 1).
      */
     std::string log;
-    error_number = program.getBuildInfo(devices.front(), CL_PROGRAM_BUILD_LOG, &log);
+    cl_int error_number = program.getBuildInfo(devices.front(), CL_PROGRAM_BUILD_LOG, &log);
 
     if ((error_number <= 0) && (build_success < 0)) {
         cerr << "Build log:\n " << log << endl;
@@ -165,6 +144,297 @@ bool CreateProgram(Context                 context,
     return (true);
 }
 
+static bool BuildProgramFromSources(Context                 context,
+                                    std::vector<Device>   & devices,
+                                    const Program::Sources& source,
+                                    const std::string     & options,
+                                    Program               & program)
+{
+    cl_int error_number = 0;
+
+    program = Program(context, source, &error_number);
+
+    if (error_number < 0) {
+        cerr << "Failed to create OpenCL program. " << __FILE__ << ":" << __LINE__ << endl;
+        return (false);
+    }
+
+    return (BuildCreatedProgram(devices, options, program));
+}
+
+/* cache lookup, else build(program) and store; build creates and builds */
+static bool CreateCachedProgram(Context                                  context,
+                                std::vector<Device>                    & devices,
+                                uint64_t                                 source_hash,
+                                Program                                & program,
+                                ProgramCache                            *cache,
+                                const std::string                      & options,
+                                const std::function<bool(Program&)>    & build)
+{
+    uint64_t key = 0;
+
+    if (cache != NULL) {
+        key = cache->key(source_hash, options, devices);
+
+        if (cache->load(context, devices, key, options, program)) {
+            return (true);
+        }
+    }
+
+    if (!build(program)) {
+        return (false);
+    }
+
+    /* a failed store only costs the next start a rebuild */
+    if (cache != NULL) {
+        cache->store(program, devices, key);
+    }
+
+    return (true);
+}
+
+static bool CreateCachedProgram(Context                 context,
+                                std::vector<Device>   & devices,
+                                const Program::Sources& source,
+                                uint64_t                source_hash,
+                                Program               & program,
+                                ProgramCache           *cache,
+                                const std::string     & options)
+{
+    return (CreateCachedProgram(context, devices, source_hash, program, cache, options,
+                                [&](Program& built) {
+        return (BuildProgramFromSources(context, devices, source, options, built));
+    }));
+}
+
+static Program::Sources ToProgramSources(const std::vector<std::string>& sources)
+{
+    Program::Sources source;
+
+    /* the texts stay owned by sources, OpenCL copies them */
+    for (size_t i = 0; i < sources.size(); i++) {
+        source.push_back(std::make_pair(sources[i].c_str(), sources[i].size()));
+    }
+
+    return (source);
+}
+
+static Program::Sources ToProgramSources(const std::vector<ClSourceBlob>& blobs)
+{
+    Program::Sources source;
+
+    for (size_t i = 0; i < blobs.size(); i++) {
+        source.push_back(std::make_pair(blobs[i].text, blobs[i].size));
+    }
+
+    return (source);
+}
+
+bool BuildProgram(Context                         context,
+                  std::vector<Device>           & devices,
+                  const std::vector<std::string>& sources,
+                  const std::string             & options,
+                  Program                       & program)
+{
+    return (BuildProgramFromSources(context, devices, ToProgramSources(sources), options, program));
+}
+
+bool CreateProgram(Context                 context,
+                   std::vector<Device>   & devices,
+                   std::vector<std::string>filenames,
+                   Program               & program)
+{
+    std::vector<std::string> sources;
+
+    if (!ReadProgramSources(filenames, sources)) {
+        return (false);
+    }
+
+    return (BuildProgram(context, devices, sources, "", program));
+}
+
+bool CreateProgram(Context                 context,
+                   std::vector<Device>   & devices,
+                   std::vector<std::string>filenames,
+                   Program               & program,
+                   ProgramCache          & cache,
+                   const std::string     & options)
+{
+    std::vector<std::string> sources;
+
+    if (!ReadProgramSources(filenames, sources)) {
+        return (false);
+    }
+
+    return (CreateCachedProgram(context, devices, ToProgramSources(sources),
+                                HashSources(sources), program, &cache, options));
+}
+
+bool CreateProgram(Context                          context,
+                   std::vector<Device>            & devices,
+                   const std::vector<ClSourceBlob>& blobs,
+                   Program                        & program,
+                   ProgramCache                    *cache,
+                   const std::string              & options)
+{
+    /* no file i/o and no copies, the key comes from the embedded hashes */
+    return (CreateCachedProgram(context, devices, ToProgramSources(blobs),
+                                HashSources(blobs), program, cache, options));
+}
+
+std::future<bool> CreateProgramAsync(Context                  context,
+                                     std::vector<Device>      devices,
+                                     std::vector<std::string> filenames,
+                                     Program                & program,
+                                     ProgramCache            *cache,
+                                     const std::string      & options)
+{
+    /*
+     * a thread per program rather than the clBuildProgram notify callback:
+     * many drivers still compile inside clBuildProgram when given one.
+     * builds of different programs are thread safe since opencl 1.1.
+     */
+    return std::async(std::launch::async,
+                      [context, devices, filenames, &program, cache, options]() mutable {
+        std::vector<std::string> sources;
+
+        if (!ReadProgramSources(filenames, sources)) {
+            return (false);
+        }
+
+        return (CreateCachedProgram(context, devices, ToProgramSources(sources),
+                                    HashSources(sources), program, cache, options));
+    });
+}
+
+std::future<bool> CreateProgramAsync(Context                   context,
+                                     std::vector<Device>       devices,
+                                     std::vector<ClSourceBlob> blobs,
+                                     Program                 & program,
+                                     ProgramCache             *cache,
+                                     const std::string       & options)
+{
+    return std::async(std::launch::async,
+                      [context, devices, blobs, &program, cache, options]() mutable {
+        return (CreateProgram(context, devices, blobs, program, cache, options));
+    });
+}
+
+bool IsDeviceVersionAtLeast(Device device, int major, int minor)
+{
+    std::string version;
+    int device_major = 0, device_minor = 0;
+
+    /* "OpenCL <major>.<minor> <vendor info>" */
+    if ((device.getInfo(CL_DEVICE_VERSION, &version) != CL_SUCCESS) ||
+        (sscanf(version.c_str(), "OpenCL %d.%d", &device_major, &device_minor) != 2)) {
+        return (false);
+    }
+
+    return ((device_major > major) || ((device_major == major) && (device_minor >= minor)));
+}
+
+#ifndef CL_DEVICE_IL_VERSION
+#define CL_DEVICE_IL_VERSION 0x105B // opencl 2.1, CL_DEVICE_IL_VERSION_KHR before
+#endif
+
+typedef cl_program (CL_API_CALL *CreateProgramWithILFunc)(cl_context, const void *, size_t, cl_int *);
+
+static CreateProgramWithILFunc GetCreateProgramWithIL(Device device)
+{
+    std::string il_version;
+
+    if ((device.getInfo(CL_DEVICE_IL_VERSION, &il_version) != CL_SUCCESS) ||
+        (il_version.find("SPIR-V") == std::string::npos)) {
+        return (NULL);
+    }
+
+#ifdef CL_VERSION_2_1
+    if (IsDeviceVersionAtLeast(device, 2, 1)) {
+        return (clCreateProgramWithIL);
+    }
+#endif
+
+    /* opencl 2.0 devices and 1.2 headers, through the extension */
+    if (!IsExtensionSupported(device, "cl_khr_il_program")) {
+        return (NULL);
+    }
+
+    cl_platform_id platform = NULL;
+    device.getInfo(CL_DEVICE_PLATFORM, &platform);
+
+    return ((CreateProgramWithILFunc)clGetExtensionFunctionAddressForPlatform(platform,
+                                                                              "clCreateProgramWithILKHR"));
+}
+
+bool IsILSupported(const std::vector<Device>& devices)
+{
+    for (size_t i = 0; i < devices.size(); i++) {
+        if (GetCreateProgramWithIL(devices[i]) == NULL) {
+            return (false);
+        }
+    }
+
+    return (!devices.empty());
+}
+
+static bool ReadBinaryFile(const std::string& filename, std::vector<char>& data)
+{
+    ifstream file(filename.c_str(), ios::in | ios::binary);
+
+    if (!file.is_open()) {
+        return (false);
+    }
+
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    return (!data.empty());
+}
+
+bool CreateProgramFromIL(Context                          context,
+                         std::vector<Device>            & devices,
+                         const std::string              & il_filename,
+                         const std::vector<ClSourceBlob>& fallback,
+                         Program                        & program,
+                         ProgramCache                    *cache,
+                         const std::string              & options,
+                         bool                            *used_il)
+{
+    std::vector<char> il;
+
+    if (used_il != NULL) {
+        *used_il = false;
+    }
+
+    if (IsILSupported(devices) && ReadBinaryFile(il_filename, il)) {
+        CreateProgramWithILFunc create_with_il = GetCreateProgramWithIL(devices.front());
+
+        bool created = CreateCachedProgram(context, devices, HashBytes(&il[0], il.size()),
+                                           program, cache, options, [&](Program& built) {
+            cl_int error_number = 0;
+            cl_program il_program = create_with_il(context(), &il[0], il.size(), &error_number);
+
+            if (error_number != CL_SUCCESS) {
+                CL_WARN("create program from " + il_filename + " fail: " + ErrorNumberToString(error_number) + " ");
+                return (false);
+            }
+            built = Program(il_program);
+
+            return (BuildCreatedProgram(devices, options, built));
+        });
+
+        if (created) {
+            if (used_il != NULL) {
+                *used_il = true;
+            }
+            return (true);
+        }
+    }
+
+    /* no il support, no il file, or the driver rejected it */
+    return (CreateProgram(context, devices, fallback, program, cache, options));
+}
+
 inline bool CheckSuccess(cl_int error_number)
 {
     if (error_number != CL_SUCCESS) {
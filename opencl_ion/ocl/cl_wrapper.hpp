@@ -7,11 +7,13 @@
 #include "cl.hpp"
 #endif
 #include "cl_common.hpp"
+#include "cl_source_blob.hpp"
 
 #include "cl_wrapper.hpp"
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <future>
 #include <vector>
 
 /**
@@ -24,7 +26,7 @@ bool PrintProfilingInfo(std::string info,
                         cl::Event   event);
 
 /**
- * [create opencl context]
+ * [create opencl context on the best ranked device, see RankDevices()]
  * @param  context [the new context]
  * @return         [true for success]
  */
@@ -63,6 +65,146 @@ bool CreateProgram(cl::Context              context,
                    std::vector<std::string>filenames,
                    cl::Program            & program);
 
+class ProgramCache;
+
+/**
+ * [create program from file, loading the binaries from cache when the
+ *  sources, options and driver match; a miss builds and stores them]
+ * @param  context   [opencl context]
+ * @param  devices   [opencl device]
+ * @param  filenames [program file names]
+ * @param  program   [return program]
+ * @param  cache     [binary cache, see cl_program_cache.hpp]
+ * @param  options   [build options]
+ * @return           [true if success]
+ */
+bool CreateProgram(cl::Context              context,
+                   std::vector<cl::Device>& devices,
+                   std::vector<std::string>filenames,
+                   cl::Program            & program,
+                   ProgramCache           & cache,
+                   const std::string      & options = "");
+
+/**
+ * [CreateProgram() on its own thread, so independent programs compile
+ *  concurrently and overlap the rest of the startup (command queues, ion
+ *  allocations). program, and cache if given, must stay alive until the
+ *  future is ready; the other arguments are copied]
+ * @param  context   [opencl context]
+ * @param  devices   [opencl device]
+ * @param  filenames [program file names]
+ * @param  program   [return program, valid once the future is ready]
+ * @param  cache     [binary cache, NULL builds from source]
+ * @param  options   [build options]
+ * @return           [future of the CreateProgram() result]
+ */
+std::future<bool> CreateProgramAsync(cl::Context              context,
+                                     std::vector<cl::Device>  devices,
+                                     std::vector<std::string> filenames,
+                                     cl::Program            & program,
+                                     ProgramCache            *cache = NULL,
+                                     const std::string      & options = "");
+
+/**
+ * [create program from sources embedded by tools/embed_cl (gen/cl_sources.hpp),
+ *  with no file i/o; the embedded hashes key the cache]
+ * @param  context [opencl context]
+ * @param  devices [opencl device]
+ * @param  blobs   [embedded sources, e.g. cl_source_hello]
+ * @param  program [return program]
+ * @param  cache   [binary cache, NULL builds from source]
+ * @param  options [build options]
+ * @return         [true if success]
+ */
+bool CreateProgram(cl::Context                      context,
+                   std::vector<cl::Device>        & devices,
+                   const std::vector<ClSourceBlob>& blobs,
+                   cl::Program                    & program,
+                   ProgramCache                    *cache = NULL,
+                   const std::string              & options = "");
+
+/**
+ * [CreateProgramAsync() for embedded sources]
+ * @param  context [opencl context]
+ * @param  devices [opencl device]
+ * @param  blobs   [embedded sources]
+ * @param  program [return program, valid once the future is ready]
+ * @param  cache   [binary cache, NULL builds from source]
+ * @param  options [build options]
+ * @return         [future of the CreateProgram() result]
+ */
+std::future<bool> CreateProgramAsync(cl::Context               context,
+                                     std::vector<cl::Device>   devices,
+                                     std::vector<ClSourceBlob> blobs,
+                                     cl::Program             & program,
+                                     ProgramCache             *cache = NULL,
+                                     const std::string       & options = "");
+
+/**
+ * [create program from SPIR-V made offline by "make spirv" (gen/<name>.spv)
+ *  when every device takes it, from the source blobs otherwise or if the
+ *  driver rejects it. -D options do not reach the IL, build variants from
+ *  source]
+ * @param  context     [opencl context]
+ * @param  devices     [opencl device]
+ * @param  il_filename [SPIR-V module]
+ * @param  fallback    [embedded sources of the same program]
+ * @param  program     [return program]
+ * @param  cache       [binary cache, NULL builds every time]
+ * @param  options     [build options]
+ * @param  used_il     [return true if the program came from the IL, false
+ *                      if it fell back to the sources; NULL to ignore]
+ * @return             [true if success]
+ */
+bool CreateProgramFromIL(cl::Context                      context,
+                         std::vector<cl::Device>        & devices,
+                         const std::string              & il_filename,
+                         const std::vector<ClSourceBlob>& fallback,
+                         cl::Program                    & program,
+                         ProgramCache                    *cache = NULL,
+                         const std::string              & options = "",
+                         bool                            *used_il = NULL);
+
+/**
+ * check if every device takes SPIR-V, through clCreateProgramWithIL
+ * (opencl 2.1) or cl_khr_il_program
+ * @param  devices [opencl devices]
+ * @return         [true if supported]
+ */
+bool IsILSupported(const std::vector<cl::Device>& devices);
+
+/**
+ * @param  device [opencl device]
+ * @param  major  [opencl major version]
+ * @param  minor  [opencl minor version]
+ * @return        [true if CL_DEVICE_VERSION is major.minor or later]
+ */
+bool IsDeviceVersionAtLeast(cl::Device device, int major, int minor);
+
+/**
+ * [read program files]
+ * @param  filenames [program file names]
+ * @param  sources   [return file contents]
+ * @return           [true if success]
+ */
+bool ReadProgramSources(const std::vector<std::string>& filenames,
+                        std::vector<std::string>      & sources);
+
+/**
+ * [create and build a program from source texts]
+ * @param  context [opencl context]
+ * @param  devices [opencl device]
+ * @param  sources [source texts]
+ * @param  options [build options]
+ * @param  program [return program]
+ * @return         [true if success]
+ */
+bool BuildProgram(cl::Context                     context,
+                  std::vector<cl::Device>       & devices,
+                  const std::vector<std::string>& sources,
+                  const std::string             & options,
+                  cl::Program                   & program);
+
 /**
  * [print error string & convert error number to string]
  * @param  error_number [error number]
@@ -0,0 +1,179 @@
+#include "planar_frame.hpp"
+
+/* cl_khr_image2d_from_buffer, pixels */
+#ifndef CL_DEVICE_IMAGE_PITCH_ALIGNMENT_KHR
+#define CL_DEVICE_IMAGE_PITCH_ALIGNMENT_KHR 0x104A
+#endif
+
+static size_t align_up(size_t value, size_t align)
+{
+    return (value + align - 1) / align * align;
+}
+
+static size_t gcd(size_t a, size_t b)
+{
+    while (b != 0) {
+        size_t r = a % b;
+        a = b;
+        b = r;
+    }
+
+    return a;
+}
+
+/* bytes a row pitch is a multiple of, for elements of element_bytes */
+static size_t pitch_align_bytes(size_t pitch_align_pixels, size_t element_bytes)
+{
+    size_t device = (pitch_align_pixels > 0) ? pitch_align_pixels * element_bytes : 1;
+
+    return PLANAR_PITCH_ALIGN / gcd(PLANAR_PITCH_ALIGN, device) * device;
+}
+
+static DmaBufPlane make_plane(size_t          offset,
+                              size_t          width,
+                              size_t          height,
+                              size_t          row_pitch,
+                              cl_channel_order order)
+{
+    DmaBufPlane plane;
+
+    plane.offset                         = offset;
+    plane.width                          = width;
+    plane.height                         = height;
+    plane.row_pitch                      = row_pitch;
+    plane.format.image_channel_order     = order;
+    plane.format.image_channel_data_type = CL_UNORM_INT8;
+
+    return plane;
+}
+
+size_t GetPlanarFrameLayout(PlanarFormat              format,
+                            size_t                    width,
+                            size_t                    height,
+                            size_t                    pitch_align_pixels,
+                            size_t                    plane_align,
+                            std::vector<DmaBufPlane>& planes)
+{
+    planes.clear();
+
+    if ((width == 0) || (height == 0) || (width % 2 != 0) || (height % 2 != 0)) {
+        return 0;
+    }
+
+    /*
+     * the device aligns pitches in pixels: 1 byte on CL_R, 2 on the nv12
+     * CL_RG plane. nv12 UV shares the luma pitch, so that pitch must suit
+     * both element sizes.
+     */
+    size_t y_align     = pitch_align_bytes(pitch_align_pixels, (format == PLANAR_NV12) ? 2 : 1);
+    size_t y_pitch     = align_up(width, y_align);
+    size_t y_scanlines = align_up(height, PLANAR_SCANLINE_ALIGN);
+    size_t offset      = 0;
+
+    planes.push_back(make_plane(offset, width, height, y_pitch, CL_R));
+    offset = align_up(y_pitch * y_scanlines, plane_align);
+
+    if (format == PLANAR_NV12) {
+        /* CbCr pairs: half the pixels, same bytes per row as luma */
+        planes.push_back(make_plane(offset, width / 2, height / 2, y_pitch, CL_RG));
+        offset += y_pitch * (y_scanlines / 2);
+    } else {
+        size_t c_pitch = align_up(width / 2, pitch_align_bytes(pitch_align_pixels, 1));
+
+        for (int i = 0; i < 2; i++) {
+            planes.push_back(make_plane(offset, width / 2, height / 2, c_pitch, CL_R));
+            offset = align_up(offset + c_pitch * (y_scanlines / 2), plane_align);
+        }
+    }
+
+    return offset;
+}
+
+PlanarFrame::PlanarFrame()
+    : format_(PLANAR_NV12),
+    size_(0)
+{}
+
+PlanarFrame::~PlanarFrame()
+{
+    release();
+}
+
+bool PlanarFrame::init(cl::Context   context,
+                       cl::Device    device,
+                       PlanarFormat  format,
+                       size_t        width,
+                       size_t        height,
+                       cl_mem_flags  flags,
+                       cl_uint       host_cache_policy,
+                       IonAllocator& allocator)
+{
+    release();
+
+    bool    images_supported = IsExtensionSupported(device, "cl_khr_image2d_from_buffer");
+    cl_uint pitch_pixels     = 0;
+    cl_uint align_bits       = 0;
+    size_t  plane_align      = PLANAR_PLANE_ALIGN;
+
+    /* in pixels of the image format, GetPlanarFrameLayout() converts per plane */
+    if (images_supported &&
+        (clGetDeviceInfo(device(), CL_DEVICE_IMAGE_PITCH_ALIGNMENT_KHR,
+                         sizeof(pitch_pixels), &pitch_pixels, NULL) != CL_SUCCESS)) {
+        pitch_pixels = 0;
+    }
+
+    /* plane images sit on sub-buffers, whose origin needs the base alignment */
+    if (device.getInfo(CL_DEVICE_MEM_BASE_ADDR_ALIGN, &align_bits) == CL_SUCCESS) {
+        while (plane_align < align_bits / 8) {
+            plane_align <<= 1;
+        }
+    }
+
+    size_ = GetPlanarFrameLayout(format, width, height, pitch_pixels, plane_align, planes_);
+
+    if (size_ == 0) {
+        CL_WARN("invalid planar frame size ");
+        return (false);
+    }
+
+    if (allocator.allocate(size_, frame_, IonAllocFlagsForPolicy(host_cache_policy), "planar_frame") < 0) {
+        CL_WARN("Failed to allocate planar frame ");
+        release();
+        return (false);
+    }
+
+    if (!CreateIonBuffer(context, flags, frame_, host_cache_policy, buffer_)) {
+        release();
+        return (false);
+    }
+
+    format_ = format;
+
+    if (!images_supported) {
+        INFO("cl_khr_image2d_from_buffer not supported, planar frame is buffer only");
+        return (true);
+    }
+
+    images_.resize(planes_.size());
+
+    for (size_t i = 0; i < planes_.size(); i++) {
+        if (!CreateImage2DFromBuffer(context, buffer_, planes_[i].offset, planes_[i].format,
+                                     planes_[i].width, planes_[i].height, planes_[i].row_pitch,
+                                     flags, images_[i])) {
+            release();
+            return (false);
+        }
+    }
+
+    return (true);
+}
+
+void PlanarFrame::release()
+{
+    /* cl objects go before the memory behind them */
+    images_.clear();
+    buffer_ = cl::Buffer();
+    frame_.reset();
+    planes_.clear();
+    size_ = 0;
+}
@@ -0,0 +1,121 @@
+#ifndef __PLANAR_FRAME_HPP__
+#define __PLANAR_FRAME_HPP__
+
+#include "dma_buf_import.hpp"
+
+#include <vector>
+
+enum PlanarFormat {
+    PLANAR_NV12, // Y plane, then one interleaved CbCr plane at half resolution
+    PLANAR_I420, // Y plane, then Cb and Cr planes at half resolution
+};
+
+#define PLANAR_PITCH_ALIGN    64   // bytes, minimum row pitch alignment
+#define PLANAR_SCANLINE_ALIGN 32   // rows, luma height padding of video hardware
+#define PLANAR_PLANE_ALIGN    4096 // bytes, plane offsets start on a page
+
+/**
+ * plane layout of a frame in one buffer. rows are padded to a multiple of
+ * PLANAR_PITCH_ALIGN bytes and of pitch_align_pixels pixels of every plane
+ * using the pitch, the luma plane to PLANAR_SCANLINE_ALIGN rows and every
+ * plane starts at a multiple of plane_align, so camera and video buffers of
+ * the same size share the layout.
+ * @param  format             [nv12 or i420]
+ * @param  width              [luma pixels, even]
+ * @param  height             [luma pixels, even]
+ * @param  pitch_align_pixels [CL_DEVICE_IMAGE_PITCH_ALIGNMENT_KHR, 0 for none]
+ * @param  plane_align        [plane offset alignment in bytes, a power of two]
+ * @param  planes      [return planes: Y, UV for nv12 or Y, U, V for i420]
+ * @return             [total bytes, 0 for an invalid size]
+ */
+size_t GetPlanarFrameLayout(PlanarFormat              format,
+                            size_t                    width,
+                            size_t                    height,
+                            size_t                    pitch_align_pixels,
+                            size_t                    plane_align,
+                            std::vector<DmaBufPlane>& planes);
+
+/**
+ * one nv12 or i420 frame in a single ion allocation, with every plane
+ * exposed as a cl::Image2D on top of the frame buffer (Y as CL_R, NV12 UV
+ * as CL_RG) so kernels sample them without copies.
+ *
+ * without cl_khr_image2d_from_buffer only the buffer is created, kernels
+ * then read the planes through buffer() at plane(i).offset.
+ */
+class PlanarFrame {
+public:
+    PlanarFrame();
+    ~PlanarFrame();
+
+    /**
+     * allocate the frame and create the plane images
+     * @param  context           [opencl context]
+     * @param  device            [device the images are used on]
+     * @param  format            [nv12 or i420]
+     * @param  width             [luma pixels, even]
+     * @param  height            [luma pixels, even]
+     * @param  flags             [memory flags of the buffer and the images]
+     * @param  host_cache_policy [host cache policy of the frame]
+     * @param  allocator         [ion allocator of the frame]
+     * @return                   [true for success]
+     */
+    bool init(cl::Context   context,
+              cl::Device    device,
+              PlanarFormat  format,
+              size_t        width,
+              size_t        height,
+              cl_mem_flags  flags = CL_MEM_READ_WRITE,
+              cl_uint       host_cache_policy = CL_MEM_HOST_UNCACHED_QCOM,
+              IonAllocator& allocator = IonAllocator::instance());
+
+    /**
+     * drop the images, the buffer and the allocation
+     */
+    void release();
+
+    PlanarFormat format() const { return format_; }
+
+    size_t plane_count() const { return planes_.size(); }
+
+    const DmaBufPlane& plane(size_t index) const { return planes_[index]; }
+
+    /**
+     * @return [true if plane images were created]
+     */
+    bool has_images() const { return !images_.empty(); }
+
+    /**
+     * @param  index [plane index]
+     * @return       [image of the plane, only if has_images()]
+     */
+    cl::Image2D& image(size_t index) { return images_[index]; }
+
+    /**
+     * @param  index [plane index]
+     * @return       [host address of the first row of the plane]
+     */
+    void *host_ptr(size_t index) const { return (char *)frame_.vaddr + planes_[index].offset; }
+
+    cl::Buffer& buffer() { return buffer_; }
+
+    const IonBuffer& ion_buffer() const { return frame_; }
+
+    /**
+     * @return [bytes of the frame layout, without the page rounding]
+     */
+    size_t size() const { return size_; }
+
+private:
+    PlanarFrame(const PlanarFrame&) = delete;
+    PlanarFrame& operator=(const PlanarFrame&) = delete;
+
+    PlanarFormat format_;
+    std::vector<DmaBufPlane> planes_;
+    IonBuffer frame_;
+    cl::Buffer buffer_;
+    std::vector<cl::Image2D> images_;
+    size_t size_;
+};
+
+#endif // ifndef __PLANAR_FRAME_HPP__
@@ -0,0 +1,151 @@
+/*
+ * build step: turn .cl files into one header of ClSourceBlob constants
+ * (ocl/cl_source_blob.hpp), one per file plus the cl_sources[] table, e.g.
+ *   cl/hello.cl -> constexpr ClSourceBlob cl_source_hello
+ *
+ * usage: embed_cl output.hpp input.cl ...
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/* fnv-1a 64, must match HashBytes() in ocl/cl_program_cache.cpp */
+static uint64_t hash_bytes(const std::string& text)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < text.size(); i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static std::string base_name(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+
+    return (slash == std::string::npos) ? path : path.substr(slash + 1);
+}
+
+static std::string identifier(const std::string& name)
+{
+    std::string stem = name.substr(0, name.find_last_of('.'));
+    std::string id   = "cl_source_";
+
+    for (size_t i = 0; i < stem.size(); i++) {
+        char c = stem[i];
+        bool alnum = ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+                     ((c >= '0') && (c <= '9'));
+
+        id += alnum ? c : '_';
+    }
+
+    return id;
+}
+
+/* one string literal per source line, so the header stays readable */
+static std::string literal(const std::string& text)
+{
+    std::string out = "    \"";
+
+    for (size_t i = 0; i < text.size(); i++) {
+        unsigned char c = text[i];
+        char escaped[8];
+
+        switch (c) {
+        case '\n':
+            out += (i + 1 < text.size()) ? "\\n\"\n    \"" : "\\n";
+            break;
+
+        case '\\':
+            out += "\\\\";
+            break;
+
+        case '"':
+            out += "\\\"";
+            break;
+
+        case '\t':
+            out += "\\t";
+            break;
+
+        default:
+            if ((c < 0x20) || (c >= 0x7f) || (c == '?')) {
+                /* octal, hex escapes would swallow following digits; '?'
+                   for trigraphs */
+                snprintf(escaped, sizeof(escaped), "\\%03o", c);
+                out += escaped;
+            } else {
+                out += (char)c;
+            }
+        }
+    }
+
+    return out + "\"";
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s output.hpp input.cl ...\n", argv[0]);
+        return 1;
+    }
+
+    std::ostringstream header;
+    std::vector<std::string> ids;
+
+    header << "/* generated by tools/embed_cl, do not edit */\n"
+           << "#ifndef __GEN_CL_SOURCES_HPP__\n"
+           << "#define __GEN_CL_SOURCES_HPP__\n\n"
+           << "#include \"../ocl/cl_source_blob.hpp\"\n\n";
+
+    for (int i = 2; i < argc; i++) {
+        std::ifstream file(argv[i], std::ios::in | std::ios::binary);
+
+        if (!file.is_open()) {
+            fprintf(stderr, "embed_cl: cannot open %s\n", argv[i]);
+            return 1;
+        }
+
+        std::ostringstream content;
+        content << file.rdbuf();
+
+        std::string text = content.str();
+        std::string name = base_name(argv[i]);
+        char hash[32];
+
+        snprintf(hash, sizeof(hash), "0x%016llxULL", (unsigned long long)hash_bytes(text));
+        ids.push_back(identifier(name));
+
+        header << "/* " << argv[i] << " */\n"
+               << "constexpr ClSourceBlob " << ids.back() << " = {\n"
+               << "    \"" << name << "\",\n"
+               << literal(text) << ",\n"
+               << "    " << text.size() << ",\n"
+               << "    " << hash << ",\n"
+               << "};\n\n";
+    }
+
+    header << "constexpr ClSourceBlob cl_sources[] = {\n";
+
+    for (size_t i = 0; i < ids.size(); i++) {
+        header << "    " << ids[i] << ",\n";
+    }
+
+    header << "};\n\n"
+           << "#endif // ifndef __GEN_CL_SOURCES_HPP__\n";
+
+    std::ofstream out(argv[1], std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!out.is_open() || !(out << header.str())) {
+        fprintf(stderr, "embed_cl: cannot write %s\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}